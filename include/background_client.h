@@ -0,0 +1,60 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#ifndef WLCS_BACKGROUND_CLIENT_H_
+#define WLCS_BACKGROUND_CLIENT_H_
+
+#include "metrics.h"
+
+#include <chrono>
+#include <memory>
+
+namespace wlcs
+{
+class Server;
+
+/**
+ * A well-behaved client that renders continuously on its own thread,
+ * committing a new frame as soon as the previous frame callback arrives.
+ *
+ * Tests use it as a bystander, to measure how other clients' behaviour
+ * affects the frame latency of everyone else.
+ */
+class BackgroundClient
+{
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    BackgroundClient(Server& server, int width = 100, int height = 100);
+    ~BackgroundClient();
+
+    /// Stop rendering; rethrows any error the rendering thread hit
+    void stop();
+
+    /// Commit to frame callback latency of all frames committed so far
+    LatencyRecorder latency() const;
+    /// Commit to frame callback latency of frames committed between start and end
+    LatencyRecorder latency_between(TimePoint start, TimePoint end) const;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> const impl;
+};
+}
+
+#endif //WLCS_BACKGROUND_CLIENT_H_
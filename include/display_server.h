@@ -25,6 +25,11 @@ extern "C" {
 #endif
 
 typedef struct WlcsDisplayServer WlcsDisplayServer;
+typedef struct WlcsTouch WlcsTouch;
+typedef struct WlcsPointer WlcsPointer;
+
+struct wl_display;
+struct wl_surface;
 
 WlcsDisplayServer* wlcs_create_server(int argc, char const** argv) __attribute__((weak));
 void wlcs_destroy_server(WlcsDisplayServer* server) __attribute__((weak));
@@ -34,6 +39,43 @@ void wlcs_server_stop(WlcsDisplayServer* server) __attribute__((weak));
 
 int wlcs_server_create_client_socket(WlcsDisplayServer* server) __attribute__((weak));
 
+void wlcs_server_position_window_absolute(
+    WlcsDisplayServer* server,
+    struct wl_display* client,
+    struct wl_surface* surface,
+    int x,
+    int y) __attribute__((weak));
+
+/*
+ * Virtual output configuration. wlcs_server_add_output() returns an identifier
+ * for the new output, or a negative value on failure.
+ */
+int wlcs_server_add_output(WlcsDisplayServer* server, int x, int y, int width, int height) __attribute__((weak));
+void wlcs_server_remove_output(WlcsDisplayServer* server, int output_id) __attribute__((weak));
+void wlcs_server_move_output(WlcsDisplayServer* server, int output_id, int x, int y) __attribute__((weak));
+
+/*
+ * A WlcsTouch is a multi-touch device. Each contact is identified by its slot;
+ * changes made between calls to wlcs_touch_frame() are logically simultaneous
+ * and should be delivered to clients in a single wl_touch.frame group.
+ */
+WlcsTouch* wlcs_server_create_touch(WlcsDisplayServer* server) __attribute__((weak));
+void wlcs_destroy_touch(WlcsTouch* touch) __attribute__((weak));
+
+void wlcs_touch_down(WlcsTouch* touch, int slot, int x, int y) __attribute__((weak));
+void wlcs_touch_move(WlcsTouch* touch, int slot, int x, int y) __attribute__((weak));
+void wlcs_touch_up(WlcsTouch* touch, int slot) __attribute__((weak));
+void wlcs_touch_frame(WlcsTouch* touch) __attribute__((weak));
+
+/*
+ * A WlcsPointer is a pointing device such as a mouse. Positions are in the
+ * compositor's global coordinate space, as for window positioning.
+ */
+WlcsPointer* wlcs_server_create_pointer(WlcsDisplayServer* server) __attribute__((weak));
+void wlcs_destroy_pointer(WlcsPointer* pointer) __attribute__((weak));
+
+void wlcs_pointer_move_absolute(WlcsPointer* pointer, int x, int y) __attribute__((weak));
+
 #ifdef __cplusplus
 }
 #endif
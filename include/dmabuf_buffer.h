@@ -0,0 +1,62 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#ifndef WLCS_DMABUF_BUFFER_H_
+#define WLCS_DMABUF_BUFFER_H_
+
+#include <functional>
+#include <memory>
+
+struct wl_buffer;
+
+namespace wlcs
+{
+class Client;
+
+/**
+ * A linear ARGB8888 buffer submitted through zwp_linux_dmabuf_v1.
+ *
+ * The dmabuf is made from a memfd by /dev/udmabuf, so no GPU is needed;
+ * this exercises the server's zero-copy import path, and the client can
+ * still draw into the buffer through data().
+ */
+class DmabufBuffer
+{
+public:
+    /// Whether the server supports linux-dmabuf and this system has /dev/udmabuf
+    static bool available(Client& client);
+
+    DmabufBuffer(Client& client, int width, int height);
+    ~DmabufBuffer();
+
+    DmabufBuffer(DmabufBuffer&& other);
+
+    operator wl_buffer*() const;
+
+    void* data() const;
+    int stride() const;
+
+    void add_release_listener(std::function<bool()> const &on_release);
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl;
+};
+}
+
+#endif //WLCS_DMABUF_BUFFER_H_
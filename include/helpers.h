@@ -19,13 +19,60 @@
 #ifndef WLCS_HELPERS_H_
 #define WLCS_HELPERS_H_
 
+#include <chrono>
 #include <cstddef>
+#include <vector>
 
 namespace wlcs
 {
 namespace helpers
 {
-int create_anonymous_file(size_t size);
+enum AnonymousFileFlags : unsigned int
+{
+    anonymous_file_default = 0,
+    /// Back the file with huge pages, if there are any free; otherwise use normal pages
+    anonymous_file_huge_pages = 1 << 0,
+    /// Seal the file against shrinking, so a mapping of it can never SIGBUS
+    anonymous_file_seal_shrink = 1 << 1
+};
+
+/**
+ * Create an unlinked file of (at least) size bytes, suitable for sharing
+ * with the server. A huge page backed file is rounded up to a whole number
+ * of huge pages, which must also be the length of any mapping of it.
+ */
+int create_anonymous_file(size_t size, unsigned int flags = anonymous_file_default);
+
+size_t huge_page_size();
+size_t round_up_to_page(size_t size);
+size_t round_up_to_huge_page(size_t size);
+bool is_huge_page_backed(int fd);
+bool is_sealed_against_shrinking(int fd);
+
+/// The resident set size of this process (and so also of the in-process server), in bytes
+size_t resident_memory();
+/// The peak resident set size of this process since start, or the last reset, in bytes
+size_t peak_resident_memory();
+/// Restart peak_resident_memory() tracking from the current resident set size
+void reset_peak_resident_memory();
+/// The number of file descriptors this process has open
+int open_file_count();
+/// The number of memory mappings in this process
+int memory_mapping_count();
+/// CPU time used by this process so far, including the in-process server's threads
+std::chrono::nanoseconds process_cpu_time();
+
+/**
+ * Free the shared memory backing a page-aligned MAP_SHARED mapping, in every
+ * process mapping it. The contents read back as zero, and nothing will be
+ * resident until someone touches the memory again.
+ */
+void discard_pages(void* address, size_t length);
+/// Which pages of a page-aligned mapping are resident, one entry per page
+std::vector<bool> resident_pages(void* address, size_t length);
+
+/// Read an integer tuning knob (such as an iteration count) from the environment
+int get_env_int(char const* name, int default_value);
 
 void set_command_line(int argc, char const** argv);
 
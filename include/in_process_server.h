@@ -22,11 +22,73 @@
 #include <gtest/gtest.h>
 
 #include <wayland-client.h>
+#include <chrono>
 #include <functional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <time.h>
+
+struct xdg_wm_base;
+struct xdg_surface;
+struct xdg_toplevel;
+struct zwp_linux_dmabuf_v1;
+struct wp_presentation;
+struct wp_viewporter;
 
 namespace wlcs
 {
 
+/// Thrown when a test needs a hook the display server shim doesn't implement
+class ShimNotImplemented : public std::logic_error
+{
+public:
+    ShimNotImplemented() : std::logic_error("Function not implemented in display server shim")
+    {
+    }
+};
+
+class Surface;
+
+class Touch
+{
+public:
+    ~Touch();
+
+    Touch(Touch&& other);
+
+    void down_at(int slot, int x, int y);
+    void move_to(int slot, int x, int y);
+    void up(int slot);
+
+    /// Deliver all changes since the previous frame() as a single group
+    void frame();
+private:
+    friend class Server;
+    class Impl;
+    Touch(std::unique_ptr<Impl>&& impl);
+
+    std::unique_ptr<Impl> impl;
+};
+
+class Pointer
+{
+public:
+    ~Pointer();
+
+    Pointer(Pointer&& other);
+
+    void move_to(int x, int y);
+private:
+    friend class Server;
+    class Impl;
+    Pointer(std::unique_ptr<Impl>&& impl);
+
+    std::unique_ptr<Impl> impl;
+};
+
 class Server
 {
 public:
@@ -35,6 +97,16 @@ public:
 
     int create_client_socket();
 
+    void move_surface_to(Surface& surface, int x, int y);
+
+    /// Returns an identifier for use with remove_output() and move_output()
+    int add_output(int x, int y, int width, int height);
+    void remove_output(int output_id);
+    void move_output(int output_id, int x, int y);
+
+    Touch create_touch();
+    Pointer create_pointer();
+
     void start();
     void stop();
 private:
@@ -44,6 +116,21 @@ private:
 
 class Client;
 
+/// The outcome of a wp_presentation_feedback request
+struct PresentationFeedback
+{
+    /// False if the content was discarded without ever being shown
+    bool presented;
+    /// When the content was shown, on the Client::presentation_clock() clock
+    std::chrono::nanoseconds timestamp;
+    /// The output's refresh interval, or zero if it isn't constant
+    std::chrono::nanoseconds refresh;
+    /// The output's vblank counter, if it has one
+    uint64_t sequence;
+    /// wp_presentation_feedback_kind flags
+    uint32_t flags;
+};
+
 class Surface
 {
 public:
@@ -54,22 +141,115 @@ public:
 
     operator wl_surface*() const;
 
+    Client& owner() const;
+
+    /// The registry names of the live outputs this surface has entered
+    std::set<uint32_t> current_outputs() const;
+
     void add_frame_callback(std::function<void(int)> const& on_frame);
+
+    /// Request presentation feedback for the next commit of this surface
+    void add_presentation_feedback(std::function<void(PresentationFeedback const&)> const& on_feedback);
+
+    /// Run callback just before the wl_surface is destroyed; used to destroy role objects
+    void run_on_destruction(std::function<void()> const& callback);
 private:
     class Impl;
     std::unique_ptr<Impl> impl;
 };
 
+class Subsurface : public Surface
+{
+public:
+    Subsurface(Client& client, Surface& parent);
+    ~Subsurface();
+
+    Subsurface(Subsurface&& other);
+
+    operator wl_subsurface*() const;
+
+    Surface& parent() const;
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+class XdgToplevel
+{
+public:
+    XdgToplevel(Surface& surface);
+    ~XdgToplevel();
+
+    XdgToplevel(XdgToplevel&& other);
+
+    operator xdg_surface*() const;
+    operator xdg_toplevel*() const;
+
+    /**
+     * Called on each xdg_surface.configure, with the size from the
+     * preceding xdg_toplevel.configure. The configure is not acknowledged
+     * automatically; call ack_configure() with the serial.
+     */
+    void add_configure_listener(
+        std::function<void(int32_t width, int32_t height, uint32_t serial)> const& on_configure);
+
+    void ack_configure(uint32_t serial);
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+class ShmPool
+{
+public:
+    /// file_flags are helpers::AnonymousFileFlags; a huge page pool is rounded up to whole huge pages
+    ShmPool(Client& client, size_t size, unsigned int file_flags = 0);
+    ~ShmPool();
+
+    ShmPool(ShmPool&& other);
+
+    operator wl_shm_pool*() const;
+
+    /// The pool's memory, mapped into the client
+    void* data() const;
+    size_t size() const;
+
+    /// Whether the pool got the huge pages or sealing its file_flags asked for
+    bool huge_pages() const;
+    bool sealed() const;
+
+    /// Grow the pool; its data() may move, but buffers created from it remain valid
+    void resize(size_t new_size);
+
+private:
+    friend class ShmBuffer;
+
+    class Impl;
+    std::unique_ptr<Impl> impl;
+};
+
 class ShmBuffer
 {
 public:
-    ShmBuffer(Client& client, int width, int height);
+    /// Formats must be single-plane, packed RGB formats
+    ShmBuffer(Client& client, int width, int height, uint32_t format = WL_SHM_FORMAT_ARGB8888);
+    /// Create a buffer backed by pool memory starting at offset
+    ShmBuffer(
+        ShmPool& pool,
+        size_t offset,
+        int width,
+        int height,
+        uint32_t format = WL_SHM_FORMAT_ARGB8888);
     ~ShmBuffer();
 
     ShmBuffer(ShmBuffer&& other);
 
     operator wl_buffer*() const;
 
+    /// The buffer's pixels, mapped into the client
+    void* data() const;
+    int stride() const;
+
     void add_release_listener(std::function<bool()> const &on_release);
 
 private:
@@ -77,6 +257,51 @@ private:
     std::unique_ptr<Impl> impl;
 };
 
+struct TouchEvent
+{
+    enum class Type
+    {
+        down,
+        motion,
+        up,
+        frame,
+        cancel
+    };
+
+    Type type;
+    int32_t id;             ///< Not meaningful for frame and cancel events
+    wl_surface* surface;    ///< Only set for down events
+    wl_fixed_t x;           ///< Surface-local position, for down and motion events
+    wl_fixed_t y;
+    uint32_t serial;        ///< Only set for down and up events
+};
+
+struct PointerEvent
+{
+    enum class Type
+    {
+        enter,
+        leave,
+        motion
+    };
+
+    Type type;
+    wl_surface* surface;    ///< Only set for enter and leave events
+    wl_fixed_t x;           ///< Surface-local position, for enter and motion events
+    wl_fixed_t y;
+    uint32_t serial;        ///< Only set for enter and leave events
+};
+
+struct OutputState
+{
+    uint32_t name;          ///< The wl_registry name of the output global
+    wl_output* output;
+    int x;                  ///< Position in the compositor's global space, from wl_output.geometry
+    int y;
+    int width;              ///< Size of the current mode
+    int height;
+};
+
 class Client
 {
 public:
@@ -84,15 +309,51 @@ public:
     ~Client();
 
     // Accessors
+    //
+    // Globals are bound on first use, at the highest version both sides
+    // support; those that send their state when bound (such as wl_shm's
+    // formats) roundtrip to the server then.
 
     operator wl_display*() const;
 
     wl_compositor* compositor() const;
     wl_shm* shm() const;
+    /// The formats the server advertised on wl_shm
+    std::set<uint32_t> shm_formats() const;
+    wl_subcompositor* subcompositor() const;
+    xdg_wm_base* xdg_shell() const;
+    zwp_linux_dmabuf_v1* linux_dmabuf() const;
+    /// The DRM fourcc formats the server advertised on zwp_linux_dmabuf_v1
+    std::set<uint32_t> dmabuf_formats() const;
+    wp_presentation* presentation() const;
+    /// The clock wp_presentation timestamps are in
+    clockid_t presentation_clock() const;
+    wp_viewporter* viewporter() const;
+    wl_data_device_manager* data_device_manager() const;
+    wl_seat* seat() const;
+
+    std::vector<OutputState> outputs() const;
 
     Surface create_visible_surface(int width, int height);
 
+    void add_touch_listener(std::function<void(TouchEvent const&)> const& on_event);
+
+    /// The client's wl_pointer, or nullptr if the seat has no pointer capability
+    wl_pointer* pointer() const;
+    void add_pointer_listener(std::function<void(PointerEvent const&)> const& on_event);
+
+    /**
+     * Simulate the client crashing: shut down the connection without
+     * destroying anything first. The Client must still be destroyed as normal.
+     */
+    void disconnect_abruptly();
+
     void dispatch_until(std::function<bool()> const& predicate);
+    /// Dispatch events until predicate is satisfied or timeout elapses; returns predicate()
+    bool dispatch_until(
+        std::function<bool()> const& predicate,
+        std::chrono::steady_clock::duration timeout);
+    void roundtrip();
 private:
     class Impl;
     std::unique_ptr<Impl> const impl;
@@ -145,6 +406,14 @@ public:
     void TearDown() override;
 
     Server& the_server();
+
+    /**
+     * Note that the test, or part of it, can't run here, such as when the
+     * server lacks an optional protocol. The caller should return straight
+     * after unless it has other parts to run; the test passes, with a
+     * "skipped" property in the XML results.
+     */
+    static void skip(std::string const& reason);
 private:
     Server server;
 };
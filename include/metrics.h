@@ -0,0 +1,61 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#ifndef WLCS_METRICS_H_
+#define WLCS_METRICS_H_
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace wlcs
+{
+/**
+ * Collects duration samples and summarises them.
+ *
+ * Not thread-safe; tests that sample from multiple threads need one
+ * recorder per thread.
+ */
+class LatencyRecorder
+{
+public:
+    using Duration = std::chrono::steady_clock::duration;
+
+    void record(Duration sample);
+
+    size_t count() const;
+
+    Duration min() const;
+    Duration max() const;
+    Duration mean() const;
+
+    /// The sample at the given fraction (0.0 – 1.0) of the sorted samples
+    Duration percentile(double fraction) const;
+
+    /// Record the summary as properties of the running test, and print it
+    void report(std::string const& name) const;
+
+private:
+    std::vector<Duration> samples;
+};
+
+/// Record a single measured value as a property of the running test, and print it
+void report_metric(std::string const& name, double value, std::string const& unit);
+}
+
+#endif //WLCS_METRICS_H_
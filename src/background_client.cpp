@@ -0,0 +1,163 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "background_client.h"
+#include "in_process_server.h"
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+// How often to check for stop() while waiting for a frame callback
+std::chrono::milliseconds const stop_poll_interval{100};
+}
+
+class wlcs::BackgroundClient::Impl
+{
+public:
+    Impl(Server& server, int width, int height)
+        : client{server},
+          surface{client.create_visible_surface(width, height)},
+          buffer{client, width, height},
+          width{width},
+          height{height},
+          render_thread{[this]() { render_loop(); }}
+    {
+    }
+
+    ~Impl()
+    {
+        try
+        {
+            stop();
+        }
+        catch (...)
+        {
+            // Errors are reported by an explicit stop(); don't throw from a destructor
+        }
+    }
+
+    void stop()
+    {
+        running = false;
+        if (render_thread.joinable())
+        {
+            render_thread.join();
+        }
+
+        if (error)
+        {
+            std::rethrow_exception(std::exchange(error, nullptr));
+        }
+    }
+
+    LatencyRecorder latency_between(TimePoint start, TimePoint end) const
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+
+        LatencyRecorder result;
+        for (auto const& frame : frames)
+        {
+            if (frame.first >= start && frame.first < end)
+            {
+                result.record(frame.second);
+            }
+        }
+        return result;
+    }
+
+private:
+    void render_loop()
+    {
+        try
+        {
+            while (running)
+            {
+                wl_surface_attach(surface, buffer, 0, 0);
+                wl_surface_damage(surface, 0, 0, width, height);
+
+                auto const frame_consumed = std::make_shared<bool>(false);
+                surface.add_frame_callback([frame_consumed](auto) { *frame_consumed = true; });
+
+                auto const committed = std::chrono::steady_clock::now();
+                wl_surface_commit(surface);
+
+                // The server may stop sending frame callbacks; stop() mustn't wait for one forever
+                while (!client.dispatch_until([frame_consumed]() { return *frame_consumed; }, stop_poll_interval))
+                {
+                    if (!running)
+                    {
+                        return;
+                    }
+                }
+
+                auto const latency = std::chrono::steady_clock::now() - committed;
+                std::lock_guard<std::mutex> lock{mutex};
+                frames.emplace_back(committed, latency);
+            }
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+    }
+
+    Client client;
+    Surface surface;
+    ShmBuffer buffer;
+    int const width;
+    int const height;
+
+    std::atomic<bool> running{true};
+    std::exception_ptr error;
+
+    std::mutex mutable mutex;
+    std::vector<std::pair<TimePoint, LatencyRecorder::Duration>> frames;
+
+    // Declared last, so everything it uses is constructed before it starts
+    std::thread render_thread;
+};
+
+wlcs::BackgroundClient::BackgroundClient(Server& server, int width, int height)
+    : impl{std::make_unique<Impl>(server, width, height)}
+{
+}
+
+wlcs::BackgroundClient::~BackgroundClient() = default;
+
+void wlcs::BackgroundClient::stop()
+{
+    impl->stop();
+}
+
+wlcs::LatencyRecorder wlcs::BackgroundClient::latency() const
+{
+    return impl->latency_between(TimePoint::min(), TimePoint::max());
+}
+
+wlcs::LatencyRecorder wlcs::BackgroundClient::latency_between(TimePoint start, TimePoint end) const
+{
+    return impl->latency_between(start, end);
+}
@@ -0,0 +1,270 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "dmabuf_buffer.h"
+#include "helpers.h"
+#include "in_process_server.h"
+#include "linux-dmabuf-unstable-v1-client-protocol.h"
+
+#include <boost/throw_exception.hpp>
+
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/ioctl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+// From <linux/udmabuf.h>, which older kernel headers lack
+struct UdmabufCreate
+{
+    uint32_t memfd;
+    uint32_t flags;
+    uint64_t offset;
+    uint64_t size;
+};
+unsigned long const udmabuf_create = _IOW('u', 0x42, UdmabufCreate);
+uint32_t const udmabuf_flags_cloexec = 0x01;
+
+char const* const udmabuf_device = "/dev/udmabuf";
+
+// From <drm_fourcc.h>
+uint32_t const drm_format_argb8888 = 0x34325241;
+uint64_t const drm_format_mod_linear = 0;
+
+int create_udmabuf(int memfd, size_t size)
+{
+    int const device = open(udmabuf_device, O_RDWR | O_CLOEXEC);
+    if (device == -1)
+    {
+        BOOST_THROW_EXCEPTION((std::system_error{errno, std::system_category(), "Failed to open /dev/udmabuf"}));
+    }
+
+    UdmabufCreate create{static_cast<uint32_t>(memfd), udmabuf_flags_cloexec, 0, size};
+    int const dmabuf = ioctl(device, udmabuf_create, &create);
+    auto const error = errno;
+    close(device);
+
+    if (dmabuf == -1)
+    {
+        BOOST_THROW_EXCEPTION((std::system_error{error, std::system_category(), "Failed to create udmabuf"}));
+    }
+    return dmabuf;
+}
+}
+
+class wlcs::DmabufBuffer::Impl
+{
+public:
+    Impl(Client& client, int width, int height)
+        : stride_{width * 4},
+          size{wlcs::helpers::round_up_to_page(static_cast<size_t>(stride_) * height)},
+          // udmabuf only accepts memfds that can't shrink out from under it
+          memfd{wlcs::helpers::create_anonymous_file(size, wlcs::helpers::anonymous_file_seal_shrink)}
+    {
+        if (!client.linux_dmabuf())
+        {
+            close(memfd);
+            BOOST_THROW_EXCEPTION((std::runtime_error{"Server does not support zwp_linux_dmabuf_v1"}));
+        }
+
+        data_ = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+        if (data_ == MAP_FAILED)
+        {
+            close(memfd);
+            BOOST_THROW_EXCEPTION((std::system_error{errno, std::system_category(), "Failed to map dmabuf memory"}));
+        }
+
+        int dmabuf;
+        try
+        {
+            dmabuf = create_udmabuf(memfd, size);
+        }
+        catch (...)
+        {
+            munmap(data_, size);
+            close(memfd);
+            throw;
+        }
+
+        auto const params = zwp_linux_dmabuf_v1_create_params(client.linux_dmabuf());
+        try
+        {
+            zwp_linux_buffer_params_v1_add(
+                params,
+                dmabuf,
+                0,
+                0,
+                stride_,
+                drm_format_mod_linear >> 32,
+                drm_format_mod_linear & 0xffffffff);
+
+            if (zwp_linux_buffer_params_v1_get_version(params) >= ZWP_LINUX_BUFFER_PARAMS_V1_CREATE_IMMED_SINCE_VERSION)
+            {
+                buffer_ = zwp_linux_buffer_params_v1_create_immed(params, width, height, drm_format_argb8888, 0);
+            }
+            else
+            {
+                zwp_linux_buffer_params_v1_add_listener(params, &params_listener, this);
+                zwp_linux_buffer_params_v1_create(params, width, height, drm_format_argb8888, 0);
+                client.dispatch_until([this]() { return buffer_ || import_failed; });
+            }
+        }
+        catch (...)
+        {
+            // Such as a protocol error while waiting for the import
+            if (buffer_)
+            {
+                wl_buffer_destroy(buffer_);
+            }
+            zwp_linux_buffer_params_v1_destroy(params);
+            close(dmabuf);
+            munmap(data_, size);
+            close(memfd);
+            throw;
+        }
+
+        zwp_linux_buffer_params_v1_destroy(params);
+        // The request has its own copy of the fd; the server holds the dmabuf open from here
+        close(dmabuf);
+
+        if (!buffer_)
+        {
+            munmap(data_, size);
+            close(memfd);
+            BOOST_THROW_EXCEPTION((std::runtime_error{"Server failed to import dmabuf"}));
+        }
+
+        wl_buffer_add_listener(buffer_, &buffer_listener, this);
+    }
+
+    ~Impl()
+    {
+        wl_buffer_destroy(buffer_);
+        munmap(data_, size);
+        close(memfd);
+    }
+
+    wl_buffer* buffer() const
+    {
+        return buffer_;
+    }
+
+    void* data() const
+    {
+        return data_;
+    }
+
+    int stride() const
+    {
+        return stride_;
+    }
+
+    void add_release_listener(std::function<bool()> const& on_release)
+    {
+        release_notifiers.push_back(on_release);
+    }
+
+private:
+    static void on_created(void* ctx, zwp_linux_buffer_params_v1* /*params*/, wl_buffer* buffer)
+    {
+        static_cast<Impl*>(ctx)->buffer_ = buffer;
+    }
+
+    static void on_failed(void* ctx, zwp_linux_buffer_params_v1* /*params*/)
+    {
+        static_cast<Impl*>(ctx)->import_failed = true;
+    }
+
+    static constexpr zwp_linux_buffer_params_v1_listener params_listener {
+        &on_created,
+        &on_failed
+    };
+
+    static void on_release(void* ctx, wl_buffer* /*buffer*/)
+    {
+        auto me = static_cast<Impl*>(ctx);
+
+        std::vector<decltype(me->release_notifiers.begin())> expired_notifiers;
+
+        for (auto notifier = me->release_notifiers.begin(); notifier != me->release_notifiers.end(); ++notifier)
+        {
+            if (!(*notifier)())
+            {
+                expired_notifiers.push_back(notifier);
+            }
+        }
+        for (auto const& expired : expired_notifiers)
+            me->release_notifiers.erase(expired);
+    }
+
+    static constexpr wl_buffer_listener buffer_listener {
+        &on_release
+    };
+
+    int const stride_;
+    size_t const size;
+    int const memfd;
+    void* data_;
+    wl_buffer* buffer_{nullptr};
+    bool import_failed{false};
+    std::vector<std::function<bool()>> release_notifiers;
+};
+
+constexpr zwp_linux_buffer_params_v1_listener wlcs::DmabufBuffer::Impl::params_listener;
+constexpr wl_buffer_listener wlcs::DmabufBuffer::Impl::buffer_listener;
+
+bool wlcs::DmabufBuffer::available(Client& client)
+{
+    return client.linux_dmabuf() &&
+        client.dmabuf_formats().count(drm_format_argb8888) &&
+        access(udmabuf_device, R_OK | W_OK) == 0;
+}
+
+wlcs::DmabufBuffer::DmabufBuffer(Client& client, int width, int height)
+    : impl{std::make_unique<Impl>(client, width, height)}
+{
+}
+
+wlcs::DmabufBuffer::DmabufBuffer(DmabufBuffer&&) = default;
+wlcs::DmabufBuffer::~DmabufBuffer() = default;
+
+wlcs::DmabufBuffer::operator wl_buffer*() const
+{
+    return impl->buffer();
+}
+
+void* wlcs::DmabufBuffer::data() const
+{
+    return impl->data();
+}
+
+int wlcs::DmabufBuffer::stride() const
+{
+    return impl->stride();
+}
+
+void wlcs::DmabufBuffer::add_release_listener(std::function<bool()> const &on_release)
+{
+    impl->add_release_listener(on_release);
+}
@@ -20,11 +20,30 @@
 #include "helpers.h"
 
 #include <boost/throw_exception.hpp>
+#include <fstream>
+#include <stdexcept>
+#include <string>
 #include <system_error>
 
+#include <dirent.h>
 #include <fcntl.h>
+#include <linux/magic.h>
 #include <linux/memfd.h>
+#include <sys/mman.h>
 #include <sys/syscall.h>
+#include <sys/vfs.h>
+#include <time.h>
+#include <unistd.h>
+
+// Older kernel and libc headers predate these
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB 0x0004U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_GET_SEALS 1034
+#define F_SEAL_SHRINK 0x0002
+#endif
 
 namespace
 {
@@ -39,16 +58,65 @@ bool error_indicates_tmpfile_not_supported(int error)
     // that incorrectly returns EINVAL. Yay.
 }
 
-int memfd_create(char const* name, unsigned int flags)
+// Named so as not to clash with the wrapper newer glibcs declare in <sys/mman.h>
+int raw_memfd_create(char const* name, unsigned int flags)
 {
     return static_cast<int>(syscall(SYS_memfd_create, name, flags));
 }
+
+/*
+ * Creating a hugetlbfs memfd succeeds whether or not there are any huge
+ * pages to back it; only mapping it tells us whether there are.
+ */
+int create_huge_page_file(size_t size, unsigned int memfd_flags)
+{
+    int const fd = raw_memfd_create("wlcs-unnamed-huge", memfd_flags | MFD_HUGETLB);
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    if (ftruncate(fd, size) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+
+    auto const mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        close(fd);
+        return -1;
+    }
+    munmap(mapping, size);
+
+    return fd;
+}
 }
 
-int wlcs::helpers::create_anonymous_file(size_t size)
+int wlcs::helpers::create_anonymous_file(size_t size, unsigned int flags)
 {
+    unsigned int memfd_flags = MFD_CLOEXEC;
+    if (flags & anonymous_file_seal_shrink)
+    {
+        memfd_flags |= MFD_ALLOW_SEALING;
+    }
+
+    int fd = -1;
+    if (flags & anonymous_file_huge_pages)
+    {
+        auto const huge_size = round_up_to_huge_page(size);
+        fd = create_huge_page_file(huge_size, memfd_flags);
+        if (fd != -1)
+        {
+            size = huge_size;
+        }
+    }
 
-    int fd = memfd_create("wlcs-unnamed", MFD_CLOEXEC);
+    if (fd == -1)
+    {
+        fd = raw_memfd_create("wlcs-unnamed", memfd_flags);
+    }
     if (fd == -1 && errno == ENOSYS)
     {
         fd = open("/dev/shm", O_TMPFILE | O_RDWR | O_EXCL | O_CLOEXEC, S_IRWXU);
@@ -82,9 +150,190 @@ int wlcs::helpers::create_anonymous_file(size_t size)
             std::system_error(errno, std::system_category(), "Failed to resize temporary file"));
     }
 
+    // Files without memfd sealing support stay unsealed; see is_sealed_against_shrinking()
+    if (flags & anonymous_file_seal_shrink)
+    {
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK);
+    }
+
     return fd;
 }
 
+size_t wlcs::helpers::huge_page_size()
+{
+    std::ifstream meminfo{"/proc/meminfo"};
+
+    std::string line;
+    while (std::getline(meminfo, line))
+    {
+        if (line.compare(0, 13, "Hugepagesize:") == 0)
+        {
+            // Reported in kB
+            return std::stoul(line.substr(13)) * 1024;
+        }
+    }
+
+    // The x86 default, for kernels without hugetlbfs
+    return 2 * 1024 * 1024;
+}
+
+size_t wlcs::helpers::round_up_to_page(size_t size)
+{
+    auto const page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return (size + page_size - 1) / page_size * page_size;
+}
+
+size_t wlcs::helpers::round_up_to_huge_page(size_t size)
+{
+    auto const page_size = huge_page_size();
+    return (size + page_size - 1) / page_size * page_size;
+}
+
+bool wlcs::helpers::is_huge_page_backed(int fd)
+{
+    struct statfs fs;
+    return fstatfs(fd, &fs) == 0 && fs.f_type == HUGETLBFS_MAGIC;
+}
+
+bool wlcs::helpers::is_sealed_against_shrinking(int fd)
+{
+    auto const seals = fcntl(fd, F_GET_SEALS);
+    return seals != -1 && (seals & F_SEAL_SHRINK);
+}
+
+size_t wlcs::helpers::resident_memory()
+{
+    std::ifstream statm{"/proc/self/statm"};
+
+    size_t total_pages, resident_pages;
+    if (!(statm >> total_pages >> resident_pages))
+    {
+        BOOST_THROW_EXCEPTION((std::runtime_error{"Failed to read /proc/self/statm"}));
+    }
+
+    return resident_pages * sysconf(_SC_PAGESIZE);
+}
+
+size_t wlcs::helpers::peak_resident_memory()
+{
+    std::ifstream status{"/proc/self/status"};
+
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+        {
+            // Reported in kB
+            return std::stoul(line.substr(6)) * 1024;
+        }
+    }
+
+    BOOST_THROW_EXCEPTION((std::runtime_error{"Failed to find VmHWM in /proc/self/status"}));
+}
+
+void wlcs::helpers::reset_peak_resident_memory()
+{
+    std::ofstream clear_refs{"/proc/self/clear_refs"};
+    if (!(clear_refs << "5" << std::flush))
+    {
+        BOOST_THROW_EXCEPTION((std::runtime_error{"Failed to reset peak RSS through /proc/self/clear_refs"}));
+    }
+}
+
+int wlcs::helpers::open_file_count()
+{
+    auto const dir = opendir("/proc/self/fd");
+    if (!dir)
+    {
+        BOOST_THROW_EXCEPTION(
+            std::system_error(errno, std::system_category(), "Failed to open /proc/self/fd"));
+    }
+
+    int count{0};
+    while (auto const entry = readdir(dir))
+    {
+        if (entry->d_name[0] != '.')
+        {
+            ++count;
+        }
+    }
+    closedir(dir);
+
+    // Don't count the descriptor used to read the directory
+    return count - 1;
+}
+
+int wlcs::helpers::memory_mapping_count()
+{
+    std::ifstream maps{"/proc/self/maps"};
+
+    int count{0};
+    std::string line;
+    while (std::getline(maps, line))
+    {
+        ++count;
+    }
+    return count;
+}
+
+std::chrono::nanoseconds wlcs::helpers::process_cpu_time()
+{
+    timespec now;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now) == -1)
+    {
+        BOOST_THROW_EXCEPTION(
+            std::system_error(errno, std::system_category(), "Failed to read process CPU time"));
+    }
+    return std::chrono::seconds{now.tv_sec} + std::chrono::nanoseconds{now.tv_nsec};
+}
+
+void wlcs::helpers::discard_pages(void* address, size_t length)
+{
+    if (madvise(address, length, MADV_REMOVE) == -1)
+    {
+        BOOST_THROW_EXCEPTION(
+            std::system_error(errno, std::system_category(), "Failed to discard pages"));
+    }
+}
+
+std::vector<bool> wlcs::helpers::resident_pages(void* address, size_t length)
+{
+    auto const page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    std::vector<unsigned char> residency((length + page_size - 1) / page_size);
+
+    if (mincore(address, length, residency.data()) == -1)
+    {
+        BOOST_THROW_EXCEPTION(
+            std::system_error(errno, std::system_category(), "Failed to query page residency"));
+    }
+
+    std::vector<bool> resident(residency.size());
+    for (auto i = 0u; i < residency.size(); ++i)
+    {
+        resident[i] = residency[i] & 1;
+    }
+    return resident;
+}
+
+int wlcs::helpers::get_env_int(char const* name, int default_value)
+{
+    auto const value = getenv(name);
+    if (!value || !*value)
+    {
+        return default_value;
+    }
+
+    try
+    {
+        return std::stoi(value);
+    }
+    catch (std::exception const&)
+    {
+        BOOST_THROW_EXCEPTION((std::runtime_error{
+            std::string{"Invalid integer value for "} + name + ": " + value}));
+    }
+}
+
 namespace
 {
 static int argc;
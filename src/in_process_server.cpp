@@ -23,15 +23,21 @@
 #include <boost/throw_exception.hpp>
 #include <stdexcept>
 #include <wayland-client.h>
+#include "xdg-shell-client-protocol.h"
+#include "linux-dmabuf-unstable-v1-client-protocol.h"
+#include "presentation-time-client-protocol.h"
+#include "viewporter-client-protocol.h"
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <iostream>
 
-class ShimNotImplemented : public std::logic_error
-{
-public:
-    ShimNotImplemented() : std::logic_error("Function not implemented in display server shim")
-    {
-    }
-};
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 class wlcs::Server::Impl
 {
@@ -75,8 +81,87 @@ public:
         }
         else
         {
-            BOOST_THROW_EXCEPTION(ShimNotImplemented{});
+            BOOST_THROW_EXCEPTION(wlcs::ShimNotImplemented{});
+        }
+    }
+
+    void move_surface_to(Surface& surface, int x, int y)
+    {
+        if (!wlcs_server_position_window_absolute)
+        {
+            BOOST_THROW_EXCEPTION(wlcs::ShimNotImplemented{});
+        }
+        wlcs_server_position_window_absolute(server.get(), surface.owner(), surface, x, y);
+    }
+
+    int add_output(int x, int y, int width, int height)
+    {
+        if (!wlcs_server_add_output)
+        {
+            BOOST_THROW_EXCEPTION(wlcs::ShimNotImplemented{});
+        }
+
+        auto const id = wlcs_server_add_output(server.get(), x, y, width, height);
+        if (id < 0)
+        {
+            BOOST_THROW_EXCEPTION((std::runtime_error{"Failed to add output"}));
+        }
+        return id;
+    }
+
+    void remove_output(int output_id)
+    {
+        if (!wlcs_server_remove_output)
+        {
+            BOOST_THROW_EXCEPTION(wlcs::ShimNotImplemented{});
+        }
+        wlcs_server_remove_output(server.get(), output_id);
+    }
+
+    void move_output(int output_id, int x, int y)
+    {
+        if (!wlcs_server_move_output)
+        {
+            BOOST_THROW_EXCEPTION(wlcs::ShimNotImplemented{});
+        }
+        wlcs_server_move_output(server.get(), output_id, x, y);
+    }
+
+    WlcsTouch* create_touch()
+    {
+        if (!wlcs_server_create_touch ||
+            !wlcs_destroy_touch ||
+            !wlcs_touch_down ||
+            !wlcs_touch_move ||
+            !wlcs_touch_up ||
+            !wlcs_touch_frame)
+        {
+            BOOST_THROW_EXCEPTION(wlcs::ShimNotImplemented{});
+        }
+
+        auto touch = wlcs_server_create_touch(server.get());
+        if (!touch)
+        {
+            BOOST_THROW_EXCEPTION((std::runtime_error{"Failed to create touch device"}));
+        }
+        return touch;
+    }
+
+    WlcsPointer* create_pointer()
+    {
+        if (!wlcs_server_create_pointer ||
+            !wlcs_destroy_pointer ||
+            !wlcs_pointer_move_absolute)
+        {
+            BOOST_THROW_EXCEPTION(wlcs::ShimNotImplemented{});
+        }
+
+        auto pointer = wlcs_server_create_pointer(server.get());
+        if (!pointer)
+        {
+            BOOST_THROW_EXCEPTION((std::runtime_error{"Failed to create pointer device"}));
         }
+        return pointer;
     }
 
 private:
@@ -105,6 +190,128 @@ int wlcs::Server::create_client_socket()
     return impl->create_client_socket();
 }
 
+void wlcs::Server::move_surface_to(Surface& surface, int x, int y)
+{
+    impl->move_surface_to(surface, x, y);
+}
+
+int wlcs::Server::add_output(int x, int y, int width, int height)
+{
+    return impl->add_output(x, y, width, height);
+}
+
+void wlcs::Server::remove_output(int output_id)
+{
+    impl->remove_output(output_id);
+}
+
+void wlcs::Server::move_output(int output_id, int x, int y)
+{
+    impl->move_output(output_id, x, y);
+}
+
+class wlcs::Touch::Impl
+{
+public:
+    Impl(WlcsTouch* touch)
+        : touch{touch, &wlcs_destroy_touch}
+    {
+    }
+
+    void down_at(int slot, int x, int y)
+    {
+        wlcs_touch_down(touch.get(), slot, x, y);
+    }
+
+    void move_to(int slot, int x, int y)
+    {
+        wlcs_touch_move(touch.get(), slot, x, y);
+    }
+
+    void up(int slot)
+    {
+        wlcs_touch_up(touch.get(), slot);
+    }
+
+    void frame()
+    {
+        wlcs_touch_frame(touch.get());
+    }
+
+private:
+    std::unique_ptr<WlcsTouch, void(*)(WlcsTouch*)> const touch;
+};
+
+class wlcs::Pointer::Impl
+{
+public:
+    Impl(WlcsPointer* pointer)
+        : pointer{pointer, &wlcs_destroy_pointer}
+    {
+    }
+
+    void move_to(int x, int y)
+    {
+        wlcs_pointer_move_absolute(pointer.get(), x, y);
+    }
+
+private:
+    std::unique_ptr<WlcsPointer, void(*)(WlcsPointer*)> const pointer;
+};
+
+wlcs::Touch wlcs::Server::create_touch()
+{
+    return Touch{std::make_unique<Touch::Impl>(impl->create_touch())};
+}
+
+wlcs::Pointer wlcs::Server::create_pointer()
+{
+    return Pointer{std::make_unique<Pointer::Impl>(impl->create_pointer())};
+}
+
+wlcs::Touch::Touch(std::unique_ptr<Impl>&& impl)
+    : impl{std::move(impl)}
+{
+}
+
+wlcs::Touch::~Touch() = default;
+
+wlcs::Touch::Touch(Touch&&) = default;
+
+void wlcs::Touch::down_at(int slot, int x, int y)
+{
+    impl->down_at(slot, x, y);
+}
+
+void wlcs::Touch::move_to(int slot, int x, int y)
+{
+    impl->move_to(slot, x, y);
+}
+
+void wlcs::Touch::up(int slot)
+{
+    impl->up(slot);
+}
+
+void wlcs::Touch::frame()
+{
+    impl->frame();
+}
+
+wlcs::Pointer::Pointer(std::unique_ptr<Impl>&& impl)
+    : impl{std::move(impl)}
+{
+}
+
+wlcs::Pointer::~Pointer() = default;
+
+wlcs::Pointer::Pointer(Pointer&&) = default;
+
+void wlcs::Pointer::move_to(int x, int y)
+{
+    impl->move_to(x, y);
+}
+
 wlcs::InProcessServer::InProcessServer()
     : server{helpers::get_argc(), helpers::get_argv()}
 {
@@ -125,6 +332,12 @@ wlcs::Server& wlcs::InProcessServer::the_server()
     return server;
 }
 
+void wlcs::InProcessServer::skip(std::string const& reason)
+{
+    std::cout << "[  SKIPPED ] " << reason << std::endl;
+    RecordProperty("skipped", reason);
+}
+
 void throw_wayland_error(wl_display* display)
 {
     auto err = wl_display_get_error(display);
@@ -155,7 +368,7 @@ public:
         {
             display = wl_display_connect_to_fd(server.create_client_socket());
         }
-        catch (ShimNotImplemented const&)
+        catch (wlcs::ShimNotImplemented const&)
         {
             // TODO: Warn about connecting to who-knows-what
             display = wl_display_connect(NULL);
@@ -170,15 +383,33 @@ public:
         wl_registry_add_listener(registry, &registry_listener, this);
 
         server_roundtrip();
+
+        // Outputs are bound as they're announced, but their state only arrives once they are
+        if (!outputs.empty())
+        {
+            server_roundtrip();
+        }
     }
 
     ~Impl()
     {
+        for (auto const& output : outputs)
+        {
+            release_output(output->output);
+        }
+        if (touch) wl_touch_destroy(touch);
+        if (pointer) wl_pointer_destroy(pointer);
+        if (seat) wl_seat_destroy(seat);
+        if (subcompositor) wl_subcompositor_destroy(subcompositor);
         if (shm) wl_shm_destroy(shm);
         if (shell) wl_shell_destroy(shell);
+        if (xdg_shell) xdg_wm_base_destroy(xdg_shell);
+        if (linux_dmabuf) zwp_linux_dmabuf_v1_destroy(linux_dmabuf);
+        if (presentation) wp_presentation_destroy(presentation);
+        if (viewporter) wp_viewporter_destroy(viewporter);
+        if (data_device_manager) wl_data_device_manager_destroy(data_device_manager);
         if (compositor) wl_compositor_destroy(compositor);
         if (registry) wl_registry_destroy(registry);
-        if (shell_surface) wl_shell_surface_destroy(shell_surface);
         wl_display_disconnect(display);
     }
 
@@ -187,14 +418,82 @@ public:
         return display;
     }
 
-    struct wl_compositor* wl_compositor() const
+    struct wl_compositor* wl_compositor()
+    {
+        return bound(compositor, "wl_compositor");
+    }
+
+    struct wl_shm* wl_shm()
+    {
+        return bound(shm, "wl_shm");
+    }
+
+    std::set<uint32_t> const& wl_shm_formats()
+    {
+        wl_shm();
+        return shm_formats;
+    }
+
+    struct wl_subcompositor* wl_subcompositor()
+    {
+        return bound(subcompositor, "wl_subcompositor");
+    }
+
+    struct wl_shell* wl_shell()
+    {
+        return bound(shell, "wl_shell");
+    }
+
+    struct xdg_wm_base* xdg_wm_base()
+    {
+        return bound(xdg_shell, "xdg_wm_base");
+    }
+
+    struct zwp_linux_dmabuf_v1* zwp_linux_dmabuf_v1()
+    {
+        return bound(linux_dmabuf, "zwp_linux_dmabuf_v1");
+    }
+
+    std::set<uint32_t> const& zwp_linux_dmabuf_formats()
+    {
+        zwp_linux_dmabuf_v1();
+        return dmabuf_formats;
+    }
+
+    struct wp_presentation* wp_presentation()
+    {
+        return bound(presentation, "wp_presentation");
+    }
+
+    clockid_t wp_presentation_clock()
+    {
+        wp_presentation();
+        return presentation_clock;
+    }
+
+    struct wp_viewporter* wp_viewporter()
+    {
+        return bound(viewporter, "wp_viewporter");
+    }
+
+    struct wl_data_device_manager* wl_data_device_manager()
+    {
+        return bound(data_device_manager, "wl_data_device_manager");
+    }
+
+    struct wl_seat* wl_seat()
     {
-        return compositor;
+        return bound(seat, "wl_seat");
     }
 
-    struct wl_shm* wl_shm() const
+    std::vector<OutputState> current_outputs() const
     {
-        return shm;
+        std::vector<OutputState> result;
+        for (auto const& output : outputs)
+        {
+            result.push_back(*output);
+        }
+        return result;
     }
 
     Surface create_visible_surface(
@@ -204,8 +503,29 @@ public:
     {
         Surface surface{client};
 
-        shell_surface = wl_shell_get_shell_surface(shell, surface);
-        wl_shell_surface_set_toplevel(shell_surface);
+        if (xdg_wm_base())
+        {
+            auto const toplevel = new XdgToplevel{surface};
+            surface.run_on_destruction([toplevel]() { delete toplevel; });
+
+            auto const configured = std::make_shared<bool>(false);
+            toplevel->add_configure_listener(
+                [toplevel, configured](int32_t, int32_t, uint32_t serial)
+                {
+                    toplevel->ack_configure(serial);
+                    *configured = true;
+                });
+
+            // The compositor will not map an xdg_surface until its initial configure is acked
+            wl_surface_commit(surface);
+            dispatch_until([configured]() { return *configured; });
+        }
+        else
+        {
+            auto const shell_surface = wl_shell_get_shell_surface(wl_shell(), surface);
+            wl_shell_surface_set_toplevel(shell_surface);
+            surface.run_on_destruction([shell_surface]() { wl_shell_surface_destroy(shell_surface); });
+        }
 
 //        auto buffer = std::make_shared<ShmBuffer>(client, width, height);
 //
@@ -219,9 +539,44 @@ public:
         return surface;
     }
 
+    void add_touch_listener(std::function<void(TouchEvent const&)> const& on_event)
+    {
+        wl_seat();
+        if (!touch)
+        {
+            BOOST_THROW_EXCEPTION((std::runtime_error{"Server does not provide a touch device"}));
+        }
+        touch_listeners.push_back(on_event);
+    }
+
+    struct wl_pointer* wl_pointer()
+    {
+        wl_seat();
+        return pointer;
+    }
+
+    void add_pointer_listener(std::function<void(PointerEvent const&)> const& on_event)
+    {
+        if (!wl_pointer())
+        {
+            BOOST_THROW_EXCEPTION((std::runtime_error{"Server does not provide a pointer device"}));
+        }
+        pointer_listeners.push_back(on_event);
+    }
+
+    void disconnect_abruptly()
+    {
+        if (shutdown(wl_display_get_fd(display), SHUT_RDWR) < 0)
+        {
+            BOOST_THROW_EXCEPTION((std::system_error{
+                errno,
+                std::system_category(),
+                "Failed to shut down client connection"}));
+        }
+    }
+
     void dispatch_until(std::function<bool()> const& predicate)
     {
-        // TODO: Drive this with epoll on the fd and have a timerfd for timeout
         while (!predicate())
         {
             if (wl_display_dispatch(display) < 0)
@@ -231,6 +586,59 @@ public:
         }
     }
 
+    bool dispatch_until(
+        std::function<bool()> const& predicate,
+        std::chrono::steady_clock::duration timeout)
+    {
+        auto const deadline = std::chrono::steady_clock::now() + timeout;
+
+        while (!predicate())
+        {
+            while (wl_display_prepare_read(display) != 0)
+            {
+                if (wl_display_dispatch_pending(display) < 0)
+                {
+                    throw_wayland_error(display);
+                }
+            }
+            wl_display_flush(display);
+
+            auto const remaining = deadline - std::chrono::steady_clock::now();
+            if (predicate() || remaining <= remaining.zero())
+            {
+                wl_display_cancel_read(display);
+                break;
+            }
+
+            // Round up, so we don't spin when less than a millisecond remains
+            auto const timeout_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                remaining + std::chrono::milliseconds{1} - std::chrono::nanoseconds{1}).count();
+
+            pollfd display_fd{wl_display_get_fd(display), POLLIN, 0};
+            auto const result = poll(&display_fd, 1, static_cast<int>(timeout_ms));
+            if (result <= 0)
+            {
+                wl_display_cancel_read(display);
+                if (result < 0 && errno != EINTR)
+                {
+                    BOOST_THROW_EXCEPTION((std::system_error{
+                        errno,
+                        std::system_category(),
+                        "Failed to wait for Wayland events"}));
+                }
+                continue;
+            }
+
+            if (wl_display_read_events(display) < 0 ||
+                wl_display_dispatch_pending(display) < 0)
+            {
+                throw_wayland_error(display);
+            }
+        }
+
+        return predicate();
+    }
+
     void server_roundtrip()
     {
         if (wl_display_roundtrip(display) < 0)
@@ -240,6 +648,125 @@ public:
     }
 
 private:
+    struct Global
+    {
+        uint32_t name;
+        uint32_t version;
+    };
+
+    struct GlobalBinding
+    {
+        wl_interface const* interface;
+        /// The highest version whose events we handle
+        uint32_t max_version;
+        /// Whether the global sends state (such as formats) as soon as it's bound
+        bool sends_initial_state;
+        /// Store the newly bound proxy, and add any listener
+        void (*on_bound)(Impl* me, void* proxy);
+    };
+
+    /*
+     * The globals we know how to use, of which we bind a single instance.
+     * Each is bound the first time a test asks for it, so a client only
+     * pays for the globals it uses, however many the server advertises.
+     */
+    static std::unordered_map<std::string, GlobalBinding> const& global_bindings()
+    {
+        static std::unordered_map<std::string, GlobalBinding> const bindings{
+            {"wl_compositor", {&wl_compositor_interface, 4, false,
+                [](Impl* me, void* proxy)
+                {
+                    me->compositor = static_cast<struct wl_compositor*>(proxy);
+                }}},
+            {"wl_shm", {&wl_shm_interface, 1, true,
+                [](Impl* me, void* proxy)
+                {
+                    me->shm = static_cast<struct wl_shm*>(proxy);
+                    wl_shm_add_listener(me->shm, &shm_listener, me);
+                }}},
+            {"wl_shell", {&wl_shell_interface, 1, false,
+                [](Impl* me, void* proxy)
+                {
+                    me->shell = static_cast<struct wl_shell*>(proxy);
+                }}},
+            {"wl_subcompositor", {&wl_subcompositor_interface, 1, false,
+                [](Impl* me, void* proxy)
+                {
+                    me->subcompositor = static_cast<struct wl_subcompositor*>(proxy);
+                }}},
+            {"xdg_wm_base", {&xdg_wm_base_interface, 1, false,
+                [](Impl* me, void* proxy)
+                {
+                    me->xdg_shell = static_cast<struct xdg_wm_base*>(proxy);
+                    xdg_wm_base_add_listener(me->xdg_shell, &xdg_shell_listener, me);
+                }}},
+            // Version 4 replaces the format and modifier events with feedback objects
+            {"zwp_linux_dmabuf_v1", {&zwp_linux_dmabuf_v1_interface, 3, true,
+                [](Impl* me, void* proxy)
+                {
+                    me->linux_dmabuf = static_cast<struct zwp_linux_dmabuf_v1*>(proxy);
+                    zwp_linux_dmabuf_v1_add_listener(me->linux_dmabuf, &linux_dmabuf_listener, me);
+                }}},
+            {"wp_presentation", {&wp_presentation_interface, 1, true,
+                [](Impl* me, void* proxy)
+                {
+                    me->presentation = static_cast<struct wp_presentation*>(proxy);
+                    wp_presentation_add_listener(me->presentation, &presentation_listener, me);
+                }}},
+            {"wp_viewporter", {&wp_viewporter_interface, 1, false,
+                [](Impl* me, void* proxy)
+                {
+                    me->viewporter = static_cast<struct wp_viewporter*>(proxy);
+                }}},
+            {"wl_data_device_manager", {&wl_data_device_manager_interface, 3, false,
+                [](Impl* me, void* proxy)
+                {
+                    me->data_device_manager = static_cast<struct wl_data_device_manager*>(proxy);
+                }}},
+            // Version 7 is the last before wl_pointer events we don't handle
+            {"wl_seat", {&wl_seat_interface, 7, true,
+                [](Impl* me, void* proxy)
+                {
+                    me->seat = static_cast<struct wl_seat*>(proxy);
+                    wl_seat_add_listener(me->seat, &seat_listener, me);
+                }}},
+        };
+        return bindings;
+    }
+
+    /*
+     * Bind the global on first use. Binding a global that sends its state
+     * straight away needs a roundtrip, so don't first use one from inside
+     * a dispatch_until() predicate.
+     */
+    template<typename Proxy>
+    Proxy* bound(Proxy*& proxy, char const* interface)
+    {
+        if (!proxy)
+        {
+            auto const instances = globals.find(interface);
+            if (instances != globals.end())
+            {
+                // Use the earliest advertised instance still present, such as the first seat
+                auto const& global = instances->second.front();
+                auto const& binding = global_bindings().at(interface);
+                binding.on_bound(
+                    this,
+                    wl_registry_bind(
+                        registry,
+                        global.name,
+                        binding.interface,
+                        std::min(global.version, binding.max_version)));
+
+                if (binding.sends_initial_state)
+                {
+                    server_roundtrip();
+                }
+            }
+        }
+        return proxy;
+    }
+
     static void global_handler(
         void* ctx,
         wl_registry* registry,
@@ -251,44 +778,393 @@ private:
 
         auto me = static_cast<Impl*>(ctx);
 
-        if ("wl_shm"s == interface)
+        if ("wl_output"s == interface)
+        {
+            // Outputs are bound straight away, so that we can track which ones surfaces enter
+            // We only handle the events up to version 3
+            auto output = static_cast<struct wl_output*>(
+                wl_registry_bind(registry, id, &wl_output_interface, std::min(version, 3u)));
+
+            me->outputs.push_back(std::unique_ptr<OutputState>{new OutputState{id, output, 0, 0, 0, 0}});
+            wl_output_add_listener(output, output_listener(), me->outputs.back().get());
+        }
+        else if (global_bindings().count(interface))
         {
-            me->shm = static_cast<struct wl_shm*>(
-                wl_registry_bind(registry, id, &wl_shm_interface, version));
+            me->globals[interface].push_back(Global{id, version});
         }
-        else if ("wl_compositor"s == interface)
+    }
+
+    static void global_removed(void* ctx, wl_registry* /*registry*/, uint32_t id)
+    {
+        auto me = static_cast<Impl*>(ctx);
+
+        for (auto instances = me->globals.begin(); instances != me->globals.end(); ++instances)
         {
-            me->compositor = static_cast<struct wl_compositor*>(
-                wl_registry_bind(registry, id, &wl_compositor_interface, version));
+            auto& list = instances->second;
+            auto const global = std::find_if(
+                list.begin(),
+                list.end(),
+                [id](auto const& candidate) { return candidate.name == id; });
+
+            if (global != list.end())
+            {
+                list.erase(global);
+                if (list.empty())
+                {
+                    me->globals.erase(instances);
+                }
+                break;
+            }
         }
-        else if ("wl_shell"s == interface)
+
+        auto const removed = std::find_if(
+            me->outputs.begin(),
+            me->outputs.end(),
+            [id](auto const& output) { return output->name == id; });
+
+        if (removed != me->outputs.end())
         {
-            me->shell = static_cast<struct wl_shell*>(
-                wl_registry_bind(registry, id, &wl_shell_interface, version));
+            release_output((*removed)->output);
+            me->outputs.erase(removed);
         }
     }
 
     constexpr static wl_registry_listener registry_listener = {
         &global_handler,
-        nullptr
+        &global_removed
     };
 
-    struct wl_display* display;
-    struct wl_registry* registry = nullptr;
-    struct wl_compositor* compositor = nullptr;
-    struct wl_shm* shm = nullptr;
-    struct wl_shell_surface* shell_surface = nullptr;
-    struct wl_shell* shell = nullptr;
-};
-
-constexpr wl_registry_listener wlcs::Client::Impl::registry_listener;
+    static void shm_format(void* ctx, struct wl_shm* /*shm*/, uint32_t format)
+    {
+        static_cast<Impl*>(ctx)->shm_formats.insert(format);
+    }
 
-wlcs::Client::Client(Server& server)
-    : impl{std::make_unique<Impl>(server)}
-{
-}
+    constexpr static wl_shm_listener shm_listener = {
+        &shm_format
+    };
 
-wlcs::Client::~Client() = default;
+    static void dmabuf_format(void* ctx, struct zwp_linux_dmabuf_v1* /*dmabuf*/, uint32_t format)
+    {
+        static_cast<Impl*>(ctx)->dmabuf_formats.insert(format);
+    }
+
+    static void dmabuf_modifier(
+        void* ctx,
+        struct zwp_linux_dmabuf_v1* /*dmabuf*/,
+        uint32_t format,
+        uint32_t /*modifier_hi*/,
+        uint32_t /*modifier_lo*/)
+    {
+        static_cast<Impl*>(ctx)->dmabuf_formats.insert(format);
+    }
+
+    constexpr static zwp_linux_dmabuf_v1_listener linux_dmabuf_listener = {
+        &dmabuf_format,
+        &dmabuf_modifier
+    };
+
+    static void presentation_clock_id(void* ctx, struct wp_presentation* /*presentation*/, uint32_t clock_id)
+    {
+        static_cast<Impl*>(ctx)->presentation_clock = clock_id;
+    }
+
+    constexpr static wp_presentation_listener presentation_listener = {
+        &presentation_clock_id
+    };
+
+    static void xdg_shell_ping(void* /*ctx*/, struct xdg_wm_base* shell, uint32_t serial)
+    {
+        xdg_wm_base_pong(shell, serial);
+    }
+
+    constexpr static xdg_wm_base_listener xdg_shell_listener = {
+        &xdg_shell_ping
+    };
+
+    static void release_output(struct wl_output* output)
+    {
+        // Headers older than wl_output version 3 have no release request
+#ifdef WL_OUTPUT_RELEASE_SINCE_VERSION
+        if (wl_output_get_version(output) >= WL_OUTPUT_RELEASE_SINCE_VERSION)
+        {
+            wl_output_release(output);
+            return;
+        }
+#endif
+        wl_output_destroy(output);
+    }
+
+    static void output_geometry(
+        void* ctx,
+        struct wl_output*,
+        int32_t x,
+        int32_t y,
+        int32_t /*physical_width*/,
+        int32_t /*physical_height*/,
+        int32_t /*subpixel*/,
+        char const* /*make*/,
+        char const* /*model*/,
+        int32_t /*transform*/)
+    {
+        auto state = static_cast<OutputState*>(ctx);
+        state->x = x;
+        state->y = y;
+    }
+
+    static void output_mode(
+        void* ctx,
+        struct wl_output*,
+        uint32_t flags,
+        int32_t width,
+        int32_t height,
+        int32_t /*refresh*/)
+    {
+        if (flags & WL_OUTPUT_MODE_CURRENT)
+        {
+            auto state = static_cast<OutputState*>(ctx);
+            state->width = width;
+            state->height = height;
+        }
+    }
+
+    static void output_done(void*, struct wl_output*)
+    {
+    }
+
+    static void output_scale(void*, struct wl_output*, int32_t)
+    {
+    }
+
+    static wl_output_listener const* output_listener()
+    {
+        // Filled in by name, as newer libwayland headers have entries for events beyond the version we bind
+        static wl_output_listener const listener = []()
+            {
+                wl_output_listener listener{};
+                listener.geometry = &output_geometry;
+                listener.mode = &output_mode;
+                listener.done = &output_done;
+                listener.scale = &output_scale;
+                return listener;
+            }();
+        return &listener;
+    }
+
+    static void seat_capabilities(void* ctx, struct wl_seat* seat, uint32_t capabilities)
+    {
+        auto me = static_cast<Impl*>(ctx);
+
+        if ((capabilities & WL_SEAT_CAPABILITY_TOUCH) && !me->touch)
+        {
+            me->touch = wl_seat_get_touch(seat);
+            wl_touch_add_listener(me->touch, &touch_listener, me);
+        }
+        else if (!(capabilities & WL_SEAT_CAPABILITY_TOUCH) && me->touch)
+        {
+            wl_touch_destroy(me->touch);
+            me->touch = nullptr;
+        }
+
+        if ((capabilities & WL_SEAT_CAPABILITY_POINTER) && !me->pointer)
+        {
+            me->pointer = wl_seat_get_pointer(seat);
+            wl_pointer_add_listener(me->pointer, pointer_listener(), me);
+        }
+        else if (!(capabilities & WL_SEAT_CAPABILITY_POINTER) && me->pointer)
+        {
+            wl_pointer_destroy(me->pointer);
+            me->pointer = nullptr;
+        }
+    }
+
+    static void seat_name(void*, struct wl_seat*, char const*)
+    {
+    }
+
+    constexpr static wl_seat_listener seat_listener = {
+        &seat_capabilities,
+        &seat_name
+    };
+
+    void notify_touch_listeners(TouchEvent const& event)
+    {
+        for (auto const& listener : touch_listeners)
+        {
+            listener(event);
+        }
+    }
+
+    static void touch_down(
+        void* ctx,
+        wl_touch*,
+        uint32_t serial,
+        uint32_t /*time*/,
+        wl_surface* surface,
+        int32_t id,
+        wl_fixed_t x,
+        wl_fixed_t y)
+    {
+        static_cast<Impl*>(ctx)->notify_touch_listeners(
+            TouchEvent{TouchEvent::Type::down, id, surface, x, y, serial});
+    }
+
+    static void touch_up(void* ctx, wl_touch*, uint32_t serial, uint32_t /*time*/, int32_t id)
+    {
+        static_cast<Impl*>(ctx)->notify_touch_listeners(
+            TouchEvent{TouchEvent::Type::up, id, nullptr, 0, 0, serial});
+    }
+
+    static void touch_motion(void* ctx, wl_touch*, uint32_t /*time*/, int32_t id, wl_fixed_t x, wl_fixed_t y)
+    {
+        static_cast<Impl*>(ctx)->notify_touch_listeners(
+            TouchEvent{TouchEvent::Type::motion, id, nullptr, x, y, 0});
+    }
+
+    static void touch_frame(void* ctx, wl_touch*)
+    {
+        static_cast<Impl*>(ctx)->notify_touch_listeners(
+            TouchEvent{TouchEvent::Type::frame, 0, nullptr, 0, 0, 0});
+    }
+
+    static void touch_cancel(void* ctx, wl_touch*)
+    {
+        static_cast<Impl*>(ctx)->notify_touch_listeners(
+            TouchEvent{TouchEvent::Type::cancel, 0, nullptr, 0, 0, 0});
+    }
+
+    static void touch_shape(void*, wl_touch*, int32_t, wl_fixed_t, wl_fixed_t)
+    {
+    }
+
+    static void touch_orientation(void*, wl_touch*, int32_t, wl_fixed_t)
+    {
+    }
+
+    constexpr static wl_touch_listener touch_listener = {
+        &touch_down,
+        &touch_up,
+        &touch_motion,
+        &touch_frame,
+        &touch_cancel,
+        &touch_shape,
+        &touch_orientation
+    };
+
+    void notify_pointer_listeners(PointerEvent const& event)
+    {
+        for (auto const& listener : pointer_listeners)
+        {
+            listener(event);
+        }
+    }
+
+    static void pointer_enter(
+        void* ctx,
+        struct wl_pointer*,
+        uint32_t serial,
+        wl_surface* surface,
+        wl_fixed_t x,
+        wl_fixed_t y)
+    {
+        static_cast<Impl*>(ctx)->notify_pointer_listeners(
+            PointerEvent{PointerEvent::Type::enter, surface, x, y, serial});
+    }
+
+    static void pointer_leave(void* ctx, struct wl_pointer*, uint32_t serial, wl_surface* surface)
+    {
+        static_cast<Impl*>(ctx)->notify_pointer_listeners(
+            PointerEvent{PointerEvent::Type::leave, surface, 0, 0, serial});
+    }
+
+    static void pointer_motion(void* ctx, struct wl_pointer*, uint32_t /*time*/, wl_fixed_t x, wl_fixed_t y)
+    {
+        static_cast<Impl*>(ctx)->notify_pointer_listeners(
+            PointerEvent{PointerEvent::Type::motion, nullptr, x, y, 0});
+    }
+
+    static void pointer_button(void*, struct wl_pointer*, uint32_t, uint32_t, uint32_t, uint32_t)
+    {
+    }
+
+    static void pointer_axis(void*, struct wl_pointer*, uint32_t, uint32_t, wl_fixed_t)
+    {
+    }
+
+    static void pointer_frame(void*, struct wl_pointer*)
+    {
+    }
+
+    static void pointer_axis_source(void*, struct wl_pointer*, uint32_t)
+    {
+    }
+
+    static void pointer_axis_stop(void*, struct wl_pointer*, uint32_t, uint32_t)
+    {
+    }
+
+    static void pointer_axis_discrete(void*, struct wl_pointer*, uint32_t, int32_t)
+    {
+    }
+
+    static wl_pointer_listener const* pointer_listener()
+    {
+        // Filled in by name, as newer libwayland headers have entries for events beyond the version we bind
+        static wl_pointer_listener const listener = []()
+            {
+                wl_pointer_listener listener{};
+                listener.enter = &pointer_enter;
+                listener.leave = &pointer_leave;
+                listener.motion = &pointer_motion;
+                listener.button = &pointer_button;
+                listener.axis = &pointer_axis;
+                listener.frame = &pointer_frame;
+                listener.axis_source = &pointer_axis_source;
+                listener.axis_stop = &pointer_axis_stop;
+                listener.axis_discrete = &pointer_axis_discrete;
+                return listener;
+            }();
+        return &listener;
+    }
+
+    struct wl_display* display;
+    struct wl_registry* registry = nullptr;
+    struct wl_compositor* compositor = nullptr;
+    struct wl_shm* shm = nullptr;
+    struct wl_subcompositor* subcompositor = nullptr;
+    struct wl_shell* shell = nullptr;
+    struct xdg_wm_base* xdg_shell = nullptr;
+    struct zwp_linux_dmabuf_v1* linux_dmabuf = nullptr;
+    struct wp_presentation* presentation = nullptr;
+    clockid_t presentation_clock = CLOCK_MONOTONIC;
+    struct wp_viewporter* viewporter = nullptr;
+    struct wl_data_device_manager* data_device_manager = nullptr;
+    struct wl_seat* seat = nullptr;
+    struct wl_touch* touch = nullptr;
+    struct wl_pointer* pointer = nullptr;
+
+    /// Advertised globals we can bind, by interface name, in the order they were advertised
+    std::unordered_map<std::string, std::vector<Global>> globals;
+    std::set<uint32_t> shm_formats;
+    std::set<uint32_t> dmabuf_formats;
+    std::vector<std::unique_ptr<OutputState>> outputs;
+    std::vector<std::function<void(TouchEvent const&)>> touch_listeners;
+    std::vector<std::function<void(PointerEvent const&)>> pointer_listeners;
+};
+
+constexpr wl_registry_listener wlcs::Client::Impl::registry_listener;
+constexpr wl_shm_listener wlcs::Client::Impl::shm_listener;
+constexpr zwp_linux_dmabuf_v1_listener wlcs::Client::Impl::linux_dmabuf_listener;
+constexpr wp_presentation_listener wlcs::Client::Impl::presentation_listener;
+constexpr xdg_wm_base_listener wlcs::Client::Impl::xdg_shell_listener;
+constexpr wl_seat_listener wlcs::Client::Impl::seat_listener;
+constexpr wl_touch_listener wlcs::Client::Impl::touch_listener;
+
+wlcs::Client::Client(Server& server)
+    : impl{std::make_unique<Impl>(server)}
+{
+}
+
+wlcs::Client::~Client() = default;
 
 wlcs::Client::operator wl_display*() const
 {
@@ -305,31 +1181,128 @@ wl_shm* wlcs::Client::shm() const
     return impl->wl_shm();
 }
 
+std::set<uint32_t> wlcs::Client::shm_formats() const
+{
+    return impl->wl_shm_formats();
+}
+
+wl_subcompositor* wlcs::Client::subcompositor() const
+{
+    return impl->wl_subcompositor();
+}
+
+xdg_wm_base* wlcs::Client::xdg_shell() const
+{
+    return impl->xdg_wm_base();
+}
+
+zwp_linux_dmabuf_v1* wlcs::Client::linux_dmabuf() const
+{
+    return impl->zwp_linux_dmabuf_v1();
+}
+
+std::set<uint32_t> wlcs::Client::dmabuf_formats() const
+{
+    return impl->zwp_linux_dmabuf_formats();
+}
+
+wp_presentation* wlcs::Client::presentation() const
+{
+    return impl->wp_presentation();
+}
+
+clockid_t wlcs::Client::presentation_clock() const
+{
+    return impl->wp_presentation_clock();
+}
+
+wp_viewporter* wlcs::Client::viewporter() const
+{
+    return impl->wp_viewporter();
+}
+
+wl_data_device_manager* wlcs::Client::data_device_manager() const
+{
+    return impl->wl_data_device_manager();
+}
+
+wl_seat* wlcs::Client::seat() const
+{
+    return impl->wl_seat();
+}
+
+std::vector<wlcs::OutputState> wlcs::Client::outputs() const
+{
+    return impl->current_outputs();
+}
+
 wlcs::Surface wlcs::Client::create_visible_surface(int width, int height)
 {
     return impl->create_visible_surface(*this, width, height);
 }
 
+void wlcs::Client::add_touch_listener(std::function<void(TouchEvent const&)> const& on_event)
+{
+    impl->add_touch_listener(on_event);
+}
+
+wl_pointer* wlcs::Client::pointer() const
+{
+    return impl->wl_pointer();
+}
+
+void wlcs::Client::add_pointer_listener(std::function<void(PointerEvent const&)> const& on_event)
+{
+    impl->add_pointer_listener(on_event);
+}
+
+void wlcs::Client::disconnect_abruptly()
+{
+    impl->disconnect_abruptly();
+}
+
 void wlcs::Client::dispatch_until(std::function<bool()> const& predicate)
 {
     impl->dispatch_until(predicate);
 }
 
+bool wlcs::Client::dispatch_until(
+    std::function<bool()> const& predicate,
+    std::chrono::steady_clock::duration timeout)
+{
+    return impl->dispatch_until(predicate, timeout);
+}
+
+void wlcs::Client::roundtrip()
+{
+    impl->server_roundtrip();
+}
+
 class wlcs::Surface::Impl
 {
 public:
     Impl(Client& client)
-        : surface_{wl_compositor_create_surface(client.compositor())}
+        : surface_{wl_compositor_create_surface(client.compositor())},
+          owner_{client}
     {
+        wl_surface_add_listener(surface_, surface_listener(), this);
     }
 
     ~Impl()
     {
-        if (pending_callback)
+        for (auto callback = destruction_callbacks.rbegin(); callback != destruction_callbacks.rend(); ++callback)
+        {
+            (*callback)();
+        }
+
+        for (auto const& callback : pending_callbacks)
         {
-            delete static_cast<std::function<void(uint32_t)>*>(wl_callback_get_user_data(pending_callback));
+            wl_callback_destroy(callback->callback);
+        }
 
-            wl_callback_destroy(pending_callback);
+        for (auto const& feedback : pending_feedback)
+        {
+            wp_presentation_feedback_destroy(feedback->feedback);
         }
 
         wl_surface_destroy(surface_);
@@ -340,43 +1313,189 @@ public:
         return surface_;
     }
 
+    Client& owner() const
+    {
+        return owner_;
+    }
+
+    std::set<uint32_t> current_outputs() const
+    {
+        // Outputs may have been unplugged without us receiving a leave
+        std::set<uint32_t> live_outputs;
+        for (auto const& output : owner_.outputs())
+        {
+            if (entered_outputs.count(output.name))
+            {
+                live_outputs.insert(output.name);
+            }
+        }
+        return live_outputs;
+    }
+
     void add_frame_callback(std::function<void(uint32_t)> const& on_frame)
     {
-        std::unique_ptr<std::function<void(uint32_t)>> holder{
-            new std::function<void(uint32_t)>(on_frame)};
+        pending_callbacks.push_back(std::make_unique<PendingCallback>());
+        auto& pending = *pending_callbacks.back();
+        pending.owner = this;
+        pending.callback = wl_surface_frame(surface_);
+        pending.on_frame = on_frame;
+
+        wl_callback_add_listener(pending.callback, &frame_listener, &pending);
+    }
+
+    void add_presentation_feedback(std::function<void(PresentationFeedback const&)> const& on_feedback)
+    {
+        if (!owner_.presentation())
+        {
+            BOOST_THROW_EXCEPTION((std::runtime_error{"Server does not support wp_presentation"}));
+        }
+
+        pending_feedback.push_back(std::make_unique<PendingFeedback>());
+        auto& pending = *pending_feedback.back();
+        pending.owner = this;
+        pending.feedback = wp_presentation_feedback(owner_.presentation(), surface_);
+        pending.on_feedback = on_feedback;
 
-        pending_callback = wl_surface_frame(surface_);
+        wp_presentation_feedback_add_listener(pending.feedback, &feedback_listener, &pending);
+    }
 
-        // TODO: Store pending callbacks and destroy + free closure on ~Surface
-        wl_callback_add_listener(pending_callback, &frame_listener, holder.release());
+    void run_on_destruction(std::function<void()> const& callback)
+    {
+        destruction_callbacks.push_back(callback);
     }
 
 private:
+    struct PendingCallback
+    {
+        Impl* owner;
+        wl_callback* callback;
+        std::function<void(uint32_t)> on_frame;
+    };
 
-    static wl_callback* pending_callback;
+    static void frame_callback(void* ctx, wl_callback* /*callback*/, uint32_t frame_time)
+    {
+        auto const pending = static_cast<PendingCallback*>(ctx);
+
+        // Take ownership first; the listener may well add the next frame callback
+        auto& pending_list = pending->owner->pending_callbacks;
+        auto const found = std::find_if(
+            pending_list.begin(),
+            pending_list.end(),
+            [pending](auto const& candidate) { return candidate.get() == pending; });
+        auto const finished = std::move(*found);
+        pending_list.erase(found);
+
+        wl_callback_destroy(finished->callback);
+        finished->on_frame(frame_time);
+    }
+
+    static constexpr wl_callback_listener frame_listener = {
+        &frame_callback
+    };
 
-    static void frame_callback(void* ctx, wl_callback* callback, uint32_t frame_time)
+    struct PendingFeedback
     {
-        pending_callback = nullptr;
+        Impl* owner;
+        struct wp_presentation_feedback* feedback;
+        std::function<void(PresentationFeedback const&)> on_feedback;
+    };
 
-        auto frame_callback = static_cast<std::function<void(uint32_t)>*>(ctx);
+    static void complete_feedback(PendingFeedback* pending, PresentationFeedback const& result)
+    {
+        // Take ownership first; the feedback is finished with whatever the listener does
+        auto& pending_list = pending->owner->pending_feedback;
+        auto const found = std::find_if(
+            pending_list.begin(),
+            pending_list.end(),
+            [pending](auto const& candidate) { return candidate.get() == pending; });
+        auto const finished = std::move(*found);
+        pending_list.erase(found);
+
+        wp_presentation_feedback_destroy(finished->feedback);
+        finished->on_feedback(result);
+    }
 
-        (*frame_callback)(frame_time);
+    static void feedback_sync_output(void*, struct wp_presentation_feedback*, wl_output*)
+    {
+    }
 
-        wl_callback_destroy(callback);
-        delete frame_callback;
+    static void feedback_presented(
+        void* ctx,
+        struct wp_presentation_feedback* /*feedback*/,
+        uint32_t tv_sec_hi,
+        uint32_t tv_sec_lo,
+        uint32_t tv_nsec,
+        uint32_t refresh,
+        uint32_t seq_hi,
+        uint32_t seq_lo,
+        uint32_t flags)
+    {
+        auto const seconds = (static_cast<uint64_t>(tv_sec_hi) << 32) | tv_sec_lo;
+        complete_feedback(
+            static_cast<PendingFeedback*>(ctx),
+            PresentationFeedback{
+                true,
+                std::chrono::seconds{seconds} + std::chrono::nanoseconds{tv_nsec},
+                std::chrono::nanoseconds{refresh},
+                (static_cast<uint64_t>(seq_hi) << 32) | seq_lo,
+                flags});
     }
 
-    static constexpr wl_callback_listener frame_listener = {
-        &frame_callback
+    static void feedback_discarded(void* ctx, struct wp_presentation_feedback* /*feedback*/)
+    {
+        complete_feedback(
+            static_cast<PendingFeedback*>(ctx),
+            PresentationFeedback{false, {}, {}, 0, 0});
+    }
+
+    static constexpr wp_presentation_feedback_listener feedback_listener = {
+        &feedback_sync_output,
+        &feedback_presented,
+        &feedback_discarded
     };
 
+    static void surface_enter(void* ctx, wl_surface*, wl_output* output)
+    {
+        // The output may already have been released by the client
+        if (output)
+        {
+            auto me = static_cast<Impl*>(ctx);
+            me->entered_outputs.insert(static_cast<OutputState*>(wl_output_get_user_data(output))->name);
+        }
+    }
+
+    static void surface_leave(void* ctx, wl_surface*, wl_output* output)
+    {
+        if (output)
+        {
+            auto me = static_cast<Impl*>(ctx);
+            me->entered_outputs.erase(static_cast<OutputState*>(wl_output_get_user_data(output))->name);
+        }
+    }
+
+    static wl_surface_listener const* surface_listener()
+    {
+        // Filled in by name, as newer libwayland headers have entries for events beyond the version we bind
+        static wl_surface_listener const listener = []()
+            {
+                wl_surface_listener listener{};
+                listener.enter = &surface_enter;
+                listener.leave = &surface_leave;
+                return listener;
+            }();
+        return &listener;
+    }
+
     struct wl_surface* const surface_;
+    Client& owner_;
+    std::set<uint32_t> entered_outputs;
+    std::vector<std::function<void()>> destruction_callbacks;
+    std::vector<std::unique_ptr<PendingCallback>> pending_callbacks;
+    std::vector<std::unique_ptr<PendingFeedback>> pending_feedback;
 };
 
-wl_callback* wlcs::Surface::Impl::pending_callback = nullptr;
-
 constexpr wl_callback_listener wlcs::Surface::Impl::frame_listener;
+constexpr wp_presentation_feedback_listener wlcs::Surface::Impl::feedback_listener;
 
 wlcs::Surface::Surface(Client& client)
     : impl{std::make_unique<Impl>(client)}
@@ -392,34 +1511,412 @@ wlcs::Surface::operator wl_surface*() const
     return impl->surface();
 }
 
+wlcs::Client& wlcs::Surface::owner() const
+{
+    return impl->owner();
+}
+
+std::set<uint32_t> wlcs::Surface::current_outputs() const
+{
+    return impl->current_outputs();
+}
+
 void wlcs::Surface::add_frame_callback(std::function<void(int)> const& on_frame)
 {
     impl->add_frame_callback(on_frame);
 }
 
-class wlcs::ShmBuffer::Impl
+void wlcs::Surface::add_presentation_feedback(
+    std::function<void(PresentationFeedback const&)> const& on_feedback)
+{
+    impl->add_presentation_feedback(on_feedback);
+}
+
+void wlcs::Surface::run_on_destruction(std::function<void()> const& callback)
+{
+    impl->run_on_destruction(callback);
+}
+
+class wlcs::Subsurface::Impl
 {
 public:
-    Impl(Client& client, int width, int height)
+    Impl(Client& client, Surface& self, Surface& parent)
+        : parent_{parent}
     {
-        auto stride = width * 4;
-        auto size = stride * height;
-        auto fd = wlcs::helpers::create_anonymous_file(size);
+        if (!client.subcompositor())
+        {
+            BOOST_THROW_EXCEPTION((std::runtime_error{"Server does not support wl_subcompositor"}));
+        }
+        subsurface = wl_subcompositor_get_subsurface(client.subcompositor(), self, parent);
+    }
 
-        auto pool = wl_shm_create_pool(client.shm(), fd, size);
+    ~Impl()
+    {
+        wl_subsurface_destroy(subsurface);
+    }
+
+    struct wl_subsurface* wl_subsurface() const
+    {
+        return subsurface;
+    }
+
+    Surface& parent() const
+    {
+        return parent_;
+    }
+
+private:
+    struct wl_subsurface* subsurface;
+    Surface& parent_;
+};
+
+wlcs::Subsurface::Subsurface(Client& client, Surface& parent)
+    : Surface{client},
+      impl{std::make_unique<Impl>(client, *this, parent)}
+{
+}
+
+wlcs::Subsurface::~Subsurface() = default;
+
+wlcs::Subsurface::Subsurface(Subsurface&&) = default;
+
+wlcs::Subsurface::operator wl_subsurface*() const
+{
+    return impl->wl_subsurface();
+}
+
+wlcs::Surface& wlcs::Subsurface::parent() const
+{
+    return impl->parent();
+}
+
+class wlcs::XdgToplevel::Impl
+{
+public:
+    Impl(Surface& surface)
+    {
+        auto const shell = surface.owner().xdg_shell();
+        if (!shell)
+        {
+            BOOST_THROW_EXCEPTION((std::runtime_error{"Server does not support xdg_wm_base"}));
+        }
+
+        shell_surface = xdg_wm_base_get_xdg_surface(shell, surface);
+        toplevel = xdg_surface_get_toplevel(shell_surface);
+
+        xdg_surface_add_listener(shell_surface, &shell_surface_listener, this);
+        xdg_toplevel_add_listener(toplevel, toplevel_listener(), this);
+    }
+
+    ~Impl()
+    {
+        xdg_toplevel_destroy(toplevel);
+        xdg_surface_destroy(shell_surface);
+    }
+
+    struct xdg_surface* xdg_surface() const
+    {
+        return shell_surface;
+    }
+
+    struct xdg_toplevel* xdg_toplevel() const
+    {
+        return toplevel;
+    }
+
+    void add_configure_listener(std::function<void(int32_t, int32_t, uint32_t)> const& on_configure)
+    {
+        configure_listeners.push_back(on_configure);
+    }
+
+    void ack_configure(uint32_t serial)
+    {
+        xdg_surface_ack_configure(shell_surface, serial);
+    }
+
+private:
+    static void surface_configure(void* ctx, struct xdg_surface*, uint32_t serial)
+    {
+        auto me = static_cast<Impl*>(ctx);
+
+        for (auto const& listener : me->configure_listeners)
+        {
+            listener(me->pending_width, me->pending_height, serial);
+        }
+    }
+
+    static constexpr xdg_surface_listener shell_surface_listener = {
+        &surface_configure
+    };
+
+    static void toplevel_configure(
+        void* ctx,
+        struct xdg_toplevel*,
+        int32_t width,
+        int32_t height,
+        wl_array* /*states*/)
+    {
+        auto me = static_cast<Impl*>(ctx);
+        me->pending_width = width;
+        me->pending_height = height;
+    }
+
+    static void toplevel_close(void*, struct xdg_toplevel*)
+    {
+    }
+
+    static xdg_toplevel_listener const* toplevel_listener()
+    {
+        // Filled in by name, as newer wayland-protocols have entries for events beyond the version we bind
+        static xdg_toplevel_listener const listener = []()
+            {
+                xdg_toplevel_listener listener{};
+                listener.configure = &toplevel_configure;
+                listener.close = &toplevel_close;
+                return listener;
+            }();
+        return &listener;
+    }
+
+    struct xdg_surface* shell_surface;
+    struct xdg_toplevel* toplevel;
+
+    int32_t pending_width = 0;
+    int32_t pending_height = 0;
+    std::vector<std::function<void(int32_t, int32_t, uint32_t)>> configure_listeners;
+};
+
+constexpr xdg_surface_listener wlcs::XdgToplevel::Impl::shell_surface_listener;
+
+wlcs::XdgToplevel::XdgToplevel(Surface& surface)
+    : impl{std::make_unique<Impl>(surface)}
+{
+}
+
+wlcs::XdgToplevel::~XdgToplevel() = default;
+
+wlcs::XdgToplevel::XdgToplevel(XdgToplevel&&) = default;
+
+wlcs::XdgToplevel::operator xdg_surface*() const
+{
+    return impl->xdg_surface();
+}
+
+wlcs::XdgToplevel::operator xdg_toplevel*() const
+{
+    return impl->xdg_toplevel();
+}
+
+void wlcs::XdgToplevel::add_configure_listener(
+    std::function<void(int32_t width, int32_t height, uint32_t serial)> const& on_configure)
+{
+    impl->add_configure_listener(on_configure);
+}
+
+void wlcs::XdgToplevel::ack_configure(uint32_t serial)
+{
+    impl->ack_configure(serial);
+}
+
+class wlcs::ShmPool::Impl
+{
+public:
+    Impl(Client& client, size_t size, unsigned int file_flags)
+        : fd{wlcs::helpers::create_anonymous_file(size, file_flags)},
+          huge_pages_{wlcs::helpers::is_huge_page_backed(fd)},
+          sealed_{wlcs::helpers::is_sealed_against_shrinking(fd)},
+          size_{huge_pages_ ? wlcs::helpers::round_up_to_huge_page(size) : size}
+    {
+        data_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (data_ == MAP_FAILED)
+        {
+            close(fd);
+            BOOST_THROW_EXCEPTION((std::system_error{
+                errno,
+                std::system_category(),
+                "Failed to map shm pool"}));
+        }
+
+        pool = wl_shm_create_pool(client.shm(), fd, size_);
+    }
+
+    ~Impl()
+    {
+        wl_shm_pool_destroy(pool);
+        munmap(data_, size_);
+        close(fd);
+    }
+
+    wl_shm_pool* shm_pool() const
+    {
+        return pool;
+    }
+
+    void* data() const
+    {
+        return data_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    bool huge_pages() const
+    {
+        return huge_pages_;
+    }
+
+    bool sealed() const
+    {
+        return sealed_;
+    }
+
+    void resize(size_t new_size)
+    {
+        if (huge_pages_)
+        {
+            new_size = wlcs::helpers::round_up_to_huge_page(new_size);
+        }
+        if (new_size < size_)
+        {
+            BOOST_THROW_EXCEPTION((std::invalid_argument{"wl_shm_pool can only grow"}));
+        }
+
+        if (ftruncate(fd, new_size) == -1)
+        {
+            BOOST_THROW_EXCEPTION((std::system_error{
+                errno,
+                std::system_category(),
+                "Failed to grow shm pool file"}));
+        }
+
+        auto const new_data = mremap(data_, size_, new_size, MREMAP_MAYMOVE);
+        if (new_data == MAP_FAILED)
+        {
+            BOOST_THROW_EXCEPTION((std::system_error{
+                errno,
+                std::system_category(),
+                "Failed to remap shm pool"}));
+        }
+
+        data_ = new_data;
+        size_ = new_size;
+        wl_shm_pool_resize(pool, size_);
+    }
+
+private:
+    int const fd;
+    bool const huge_pages_;
+    bool const sealed_;
+    size_t size_;
+    void* data_;
+    wl_shm_pool* pool;
+};
+
+wlcs::ShmPool::ShmPool(Client& client, size_t size, unsigned int file_flags)
+    : impl{std::make_unique<Impl>(client, size, file_flags)}
+{
+}
+
+wlcs::ShmPool::ShmPool(ShmPool&&) = default;
+wlcs::ShmPool::~ShmPool() = default;
+
+wlcs::ShmPool::operator wl_shm_pool*() const
+{
+    return impl->shm_pool();
+}
+
+void* wlcs::ShmPool::data() const
+{
+    return impl->data();
+}
+
+size_t wlcs::ShmPool::size() const
+{
+    return impl->size();
+}
+
+void wlcs::ShmPool::resize(size_t new_size)
+{
+    impl->resize(new_size);
+}
+
+bool wlcs::ShmPool::huge_pages() const
+{
+    return impl->huge_pages();
+}
+
+bool wlcs::ShmPool::sealed() const
+{
+    return impl->sealed();
+}
+
+namespace
+{
+int bytes_per_pixel(uint32_t format)
+{
+    switch (format)
+    {
+    case WL_SHM_FORMAT_ARGB8888:
+    case WL_SHM_FORMAT_XRGB8888:
+    case WL_SHM_FORMAT_ABGR8888:
+    case WL_SHM_FORMAT_XBGR8888:
+    case WL_SHM_FORMAT_RGBA8888:
+    case WL_SHM_FORMAT_RGBX8888:
+    case WL_SHM_FORMAT_BGRA8888:
+    case WL_SHM_FORMAT_BGRX8888:
+    case WL_SHM_FORMAT_ARGB2101010:
+    case WL_SHM_FORMAT_XRGB2101010:
+    case WL_SHM_FORMAT_ABGR2101010:
+    case WL_SHM_FORMAT_XBGR2101010:
+        return 4;
+    case WL_SHM_FORMAT_RGB888:
+    case WL_SHM_FORMAT_BGR888:
+        return 3;
+    case WL_SHM_FORMAT_RGB565:
+    case WL_SHM_FORMAT_BGR565:
+    case WL_SHM_FORMAT_ARGB4444:
+    case WL_SHM_FORMAT_XRGB4444:
+    case WL_SHM_FORMAT_ARGB1555:
+    case WL_SHM_FORMAT_XRGB1555:
+        return 2;
+    case WL_SHM_FORMAT_RGB332:
+    case WL_SHM_FORMAT_C8:
+        return 1;
+    default:
+        BOOST_THROW_EXCEPTION((std::invalid_argument{
+            "Unsupported wl_shm format " + std::to_string(format) + " (only single-plane RGB formats are handled)"}));
+    }
+}
+}
+
+class wlcs::ShmBuffer::Impl
+{
+public:
+    Impl(ShmPool const& pool, size_t offset, int width, int height, uint32_t format)
+        : pool_{pool.impl.get()},
+          offset_{offset},
+          stride_{width * bytes_per_pixel(format)}
+    {
         buffer_ = wl_shm_pool_create_buffer(
             pool,
-            0,
+            offset,
             width,
             height,
-            stride,
-            WL_SHM_FORMAT_ARGB8888);
-        wl_shm_pool_destroy(pool);
-        close(fd);
+            stride_,
+            format);
 
         wl_buffer_add_listener(buffer_, &listener, this);
     }
 
+    // A buffer with a pool of its own keeps the pool, and so its mapping, alive
+    Impl(std::unique_ptr<ShmPool> pool, int width, int height, uint32_t format)
+        : Impl(*pool, 0, width, height, format)
+    {
+        owned_pool = std::move(pool);
+    }
+
     ~Impl()
     {
         wl_buffer_destroy(buffer_);
@@ -430,6 +1927,17 @@ public:
         return buffer_;
     }
 
+    void* data() const
+    {
+        // Looked up each time, as resizing the pool may have moved its mapping
+        return static_cast<char*>(pool_->data()) + offset_;
+    }
+
+    int stride() const
+    {
+        return stride_;
+    }
+
     void add_release_listener(std::function<bool()> const& on_release)
     {
         release_notifiers.push_back(on_release);
@@ -457,14 +1965,27 @@ private:
         &on_release
     };
 
+    std::unique_ptr<ShmPool> owned_pool;
+    ShmPool::Impl const* const pool_;
+    size_t const offset_;
+    int const stride_;
     wl_buffer* buffer_;
     std::vector<std::function<bool()>> release_notifiers;
 };
 
 constexpr wl_buffer_listener wlcs::ShmBuffer::Impl::listener;
 
-wlcs::ShmBuffer::ShmBuffer(Client &client, int width, int height)
-    : impl{std::make_unique<Impl>(client, width, height)}
+wlcs::ShmBuffer::ShmBuffer(Client &client, int width, int height, uint32_t format)
+    : impl{std::make_unique<Impl>(
+          std::make_unique<ShmPool>(client, static_cast<size_t>(width * bytes_per_pixel(format) * height)),
+          width,
+          height,
+          format)}
+{
+}
+
+wlcs::ShmBuffer::ShmBuffer(ShmPool& pool, size_t offset, int width, int height, uint32_t format)
+    : impl{std::make_unique<Impl>(pool, offset, width, height, format)}
 {
 }
 
@@ -476,6 +1997,16 @@ wlcs::ShmBuffer::operator wl_buffer*() const
     return impl->buffer();
 }
 
+void* wlcs::ShmBuffer::data() const
+{
+    return impl->data();
+}
+
+int wlcs::ShmBuffer::stride() const
+{
+    return impl->stride();
+}
+
 void wlcs::ShmBuffer::add_release_listener(std::function<bool()> const &on_release)
 {
     impl->add_release_listener(on_release);
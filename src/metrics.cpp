@@ -0,0 +1,114 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "metrics.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+
+namespace
+{
+long as_microseconds(wlcs::LatencyRecorder::Duration duration)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+}
+
+void wlcs::LatencyRecorder::record(Duration sample)
+{
+    samples.push_back(sample);
+}
+
+size_t wlcs::LatencyRecorder::count() const
+{
+    return samples.size();
+}
+
+auto wlcs::LatencyRecorder::min() const -> Duration
+{
+    if (samples.empty())
+    {
+        return Duration::zero();
+    }
+    return *std::min_element(samples.begin(), samples.end());
+}
+
+auto wlcs::LatencyRecorder::max() const -> Duration
+{
+    if (samples.empty())
+    {
+        return Duration::zero();
+    }
+    return *std::max_element(samples.begin(), samples.end());
+}
+
+auto wlcs::LatencyRecorder::mean() const -> Duration
+{
+    if (samples.empty())
+    {
+        return Duration::zero();
+    }
+    return std::accumulate(samples.begin(), samples.end(), Duration::zero()) / samples.size();
+}
+
+auto wlcs::LatencyRecorder::percentile(double fraction) const -> Duration
+{
+    if (samples.empty())
+    {
+        return Duration::zero();
+    }
+
+    auto sorted = samples;
+    auto const index = std::min(
+        static_cast<size_t>(fraction * sorted.size()),
+        sorted.size() - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
+
+void wlcs::LatencyRecorder::report(std::string const& name) const
+{
+    using testing::Test;
+
+    Test::RecordProperty(name + "_count", static_cast<int>(count()));
+    Test::RecordProperty(name + "_min_us", static_cast<int>(as_microseconds(min())));
+    Test::RecordProperty(name + "_mean_us", static_cast<int>(as_microseconds(mean())));
+    Test::RecordProperty(name + "_p50_us", static_cast<int>(as_microseconds(percentile(0.5))));
+    Test::RecordProperty(name + "_p99_us", static_cast<int>(as_microseconds(percentile(0.99))));
+    Test::RecordProperty(name + "_max_us", static_cast<int>(as_microseconds(max())));
+
+    std::cout
+        << name << ": "
+        << count() << " samples, "
+        << "min " << as_microseconds(min()) << "µs, "
+        << "mean " << as_microseconds(mean()) << "µs, "
+        << "p50 " << as_microseconds(percentile(0.5)) << "µs, "
+        << "p99 " << as_microseconds(percentile(0.99)) << "µs, "
+        << "max " << as_microseconds(max()) << "µs"
+        << std::endl;
+}
+
+void wlcs::report_metric(std::string const& name, double value, std::string const& unit)
+{
+    testing::Test::RecordProperty(name, std::to_string(value) + " " + unit);
+
+    std::cout << name << ": " << value << " " << unit << std::endl;
+}
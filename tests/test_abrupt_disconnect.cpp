@@ -0,0 +1,152 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "background_client.h"
+#include "helpers.h"
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace testing;
+
+namespace
+{
+int const crash_count{20};
+int const surfaces_per_client{4};
+int const pools_per_client{8};
+int const buffer_width{1920};
+int const buffer_height{1080};
+
+std::chrono::seconds const reclaim_timeout{5};
+std::chrono::milliseconds const reclaim_poll_interval{1};
+
+/*
+ * Everything a crashing application might leave behind: mapped surfaces
+ * with buffers attached, frame callbacks the compositor has yet to fire,
+ * and shm pools the compositor has mapped.
+ */
+struct CrashingClient
+{
+    CrashingClient(wlcs::Server& server)
+        : client{server}
+    {
+        for (int i = 0; i < pools_per_client; ++i)
+        {
+            pools.emplace_back(client, static_cast<size_t>(buffer_width * 4 * buffer_height));
+        }
+
+        for (int i = 0; i < surfaces_per_client; ++i)
+        {
+            surfaces.push_back(client.create_visible_surface(buffer_width, buffer_height));
+            buffers.emplace_back(pools[i], 0, buffer_width, buffer_height);
+
+            wl_surface_attach(surfaces.back(), buffers.back(), 0, 0);
+            wl_surface_damage(surfaces.back(), 0, 0, buffer_width, buffer_height);
+            wl_surface_commit(surfaces.back());
+        }
+
+        // Queue up another frame on each surface, with callbacks we'll never wait for
+        for (auto i = 0u; i < surfaces.size(); ++i)
+        {
+            wl_surface_attach(surfaces[i], buffers[i], 0, 0);
+            wl_surface_damage(surfaces[i], 0, 0, buffer_width, buffer_height);
+            surfaces[i].add_frame_callback([](auto) {});
+            wl_surface_commit(surfaces[i]);
+        }
+
+        client.roundtrip();
+    }
+
+    // Destruction order matters: the client has to outlive its objects
+    wlcs::Client client;
+    std::vector<wlcs::ShmPool> pools;
+    std::vector<wlcs::Surface> surfaces;
+    std::vector<wlcs::ShmBuffer> buffers;
+};
+}
+
+using AbruptDisconnectTest = wlcs::InProcessServer;
+
+TEST_F(AbruptDisconnectTest, server_reclaims_crashed_client_resources_without_stalling_others)
+{
+    wlcs::BackgroundClient bystander{the_server()};
+
+    // Let the compositor reach a steady state before taking a baseline
+    std::this_thread::sleep_for(std::chrono::milliseconds{200});
+
+    wlcs::LatencyRecorder reclaim_time;
+    std::vector<std::pair<wlcs::BackgroundClient::TimePoint, wlcs::BackgroundClient::TimePoint>> cleanup_windows;
+    int unreclaimed{0};
+
+    for (int i = 0; i < crash_count; ++i)
+    {
+        auto const baseline_fds = wlcs::helpers::open_file_count();
+        auto const baseline_mappings = wlcs::helpers::memory_mapping_count();
+
+        auto victim = std::make_unique<CrashingClient>(the_server());
+
+        victim->client.disconnect_abruptly();
+        auto const crashed = std::chrono::steady_clock::now();
+        // Releasing our side of the fds and mappings is cheap; what's left is the server's
+        victim.reset();
+
+        while (wlcs::helpers::open_file_count() > baseline_fds ||
+               wlcs::helpers::memory_mapping_count() > baseline_mappings)
+        {
+            if (std::chrono::steady_clock::now() - crashed > reclaim_timeout)
+            {
+                ++unreclaimed;
+                break;
+            }
+            // Don't compete with the server for the CPU while it cleans up
+            std::this_thread::sleep_for(reclaim_poll_interval);
+        }
+        auto const reclaimed = std::chrono::steady_clock::now();
+
+        reclaim_time.record(reclaimed - crashed);
+        cleanup_windows.emplace_back(crashed, reclaimed);
+
+        // Space the crashes out, so the bystander has quiet periods too
+        std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    }
+
+    bystander.stop();
+
+    wlcs::LatencyRecorder during_cleanup;
+    for (auto const& window : cleanup_windows)
+    {
+        auto const frames = bystander.latency_between(window.first, window.second);
+        if (frames.count() > 0)
+        {
+            during_cleanup.record(frames.max());
+        }
+    }
+
+    reclaim_time.report("crashed_client_reclaim_time");
+    bystander.latency().report("bystander_frame_latency");
+    during_cleanup.report("bystander_worst_frame_latency_during_cleanup");
+
+    EXPECT_THAT(unreclaimed, Eq(0))
+        << "Server did not release a crashed client's fds and mappings within " << reclaim_timeout.count() << "s";
+}
@@ -28,10 +28,15 @@
 #include <unistd.h>
 #include <gmock/gmock.h>
 
+#include "background_client.h"
 #include "helpers.h"
+#include "metrics.h"
 
 #include "in_process_server.h"
 
+#include <chrono>
+#include <thread>
+
 /* tests, that attempt to crash the compositor on purpose */
 
 static struct wl_buffer *
@@ -100,3 +105,69 @@ TEST_F(BadBufferTest, test_truncated_shm_file)
 
 	FAIL() << "Expected protocol error not raised";
 }
+
+/*
+ * One client repeatedly submitting truncated buffers must not degrade anyone
+ * else: measure how long the server takes to catch each SIGBUS and kill the
+ * client, and what that does to a well-behaved client's frame latency.
+ */
+TEST_F(BadBufferTest, truncated_shm_storm_does_not_stall_other_clients)
+{
+	using namespace testing;
+
+	int const storm_length{50};
+
+	wlcs::BackgroundClient bystander{the_server()};
+
+	// Let the bystander reach a steady state, and get a baseline
+	std::this_thread::sleep_for(std::chrono::milliseconds{200});
+	auto const baseline_start = std::chrono::steady_clock::now();
+	std::this_thread::sleep_for(std::chrono::milliseconds{500});
+	auto const storm_start = std::chrono::steady_clock::now();
+
+	wlcs::LatencyRecorder commit_to_error;
+	int errors_not_raised{0};
+
+	for (int i = 0; i < storm_length; ++i)
+	{
+		// The server disconnects the client on error, so each bad buffer needs a new client
+		wlcs::Client client{the_server()};
+		auto surface = client.create_visible_surface(200, 200);
+		wl_buffer* bad_buffer = create_bad_shm_buffer(client, 200, 200);
+
+		bool buffer_consumed{false};
+		wl_surface_attach(surface, bad_buffer, 0, 0);
+		wl_surface_damage(surface, 0, 0, 200, 200);
+		surface.add_frame_callback([&buffer_consumed](int) { buffer_consumed = true; });
+
+		auto const committed = std::chrono::steady_clock::now();
+		wl_surface_commit(surface);
+
+		try
+		{
+			client.dispatch_until([&buffer_consumed]() { return buffer_consumed; });
+			++errors_not_raised;
+		}
+		catch (wlcs::ProtocolError const& err)
+		{
+			commit_to_error.record(std::chrono::steady_clock::now() - committed);
+			EXPECT_THAT(err.error_code(), Eq(WL_SHM_ERROR_INVALID_FD));
+			EXPECT_THAT(err.interface(), Eq(&wl_buffer_interface));
+		}
+
+		wl_buffer_destroy(bad_buffer);
+	}
+
+	auto const storm_end = std::chrono::steady_clock::now();
+	bystander.stop();
+
+	auto const baseline = bystander.latency_between(baseline_start, storm_start);
+	auto const during_storm = bystander.latency_between(storm_start, storm_end);
+
+	commit_to_error.report("truncated_shm_commit_to_error");
+	baseline.report("truncated_shm_bystander_baseline_latency");
+	during_storm.report("truncated_shm_bystander_latency_during_storm");
+
+	EXPECT_THAT(errors_not_raised, Eq(0)) << "Truncated buffers were consumed without a protocol error";
+	EXPECT_THAT(during_storm.count(), Gt(0u)) << "Bystander rendered no frames during the storm";
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "helpers.h"
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <tuple>
+
+using namespace testing;
+
+namespace
+{
+// Not square, so that a transform which rotates the buffer changes its shape
+int const surface_width{640};
+int const surface_height{480};
+int const frame_count{120};
+
+std::string transform_name(int32_t transform)
+{
+    switch (transform)
+    {
+    case WL_OUTPUT_TRANSFORM_NORMAL: return "normal";
+    case WL_OUTPUT_TRANSFORM_90: return "90";
+    case WL_OUTPUT_TRANSFORM_180: return "180";
+    case WL_OUTPUT_TRANSFORM_270: return "270";
+    case WL_OUTPUT_TRANSFORM_FLIPPED: return "flipped";
+    case WL_OUTPUT_TRANSFORM_FLIPPED_90: return "flipped_90";
+    case WL_OUTPUT_TRANSFORM_FLIPPED_180: return "flipped_180";
+    case WL_OUTPUT_TRANSFORM_FLIPPED_270: return "flipped_270";
+    }
+    return std::to_string(transform);
+}
+
+bool rotates_by_quarter_turn(int32_t transform)
+{
+    return transform & WL_OUTPUT_TRANSFORM_90;
+}
+}
+
+class BufferTransformTest :
+    public wlcs::InProcessServer,
+    public WithParamInterface<std::tuple<int32_t, int32_t>>
+{
+};
+
+/*
+ * Animate a surface whose buffer is drawn at a scale and transform. A
+ * server can present a normal, unscaled buffer as it is; anything else
+ * goes through its renderer's scaling and rotation, which should cost
+ * little more. A combination that falls off the fast path stands out in
+ * cost per megapixel against the scale 1, normal case.
+ */
+TEST_P(BufferTransformTest, composite_cost)
+{
+    int32_t scale, transform;
+    std::tie(scale, transform) = GetParam();
+
+    wlcs::Client client{the_server()};
+    auto surface = client.create_visible_surface(surface_width, surface_height);
+    if (wl_surface_get_version(surface) < WL_SURFACE_SET_BUFFER_SCALE_SINCE_VERSION)
+    {
+        skip("Server's wl_surface is too old for set_buffer_scale");
+        return;
+    }
+
+    auto const rotated = rotates_by_quarter_turn(transform);
+    auto const buffer_width = (rotated ? surface_height : surface_width) * scale;
+    auto const buffer_height = (rotated ? surface_width : surface_height) * scale;
+    wlcs::ShmBuffer buffer{client, buffer_width, buffer_height};
+    memset(buffer.data(), 0x80, static_cast<size_t>(buffer.stride()) * buffer_height);
+
+    wl_surface_set_buffer_scale(surface, scale);
+    wl_surface_set_buffer_transform(surface, transform);
+
+    wlcs::LatencyRecorder commit_to_frame;
+    auto const cpu_start = wlcs::helpers::process_cpu_time();
+    for (int i = 0; i < frame_count; ++i)
+    {
+        wl_surface_attach(surface, buffer, 0, 0);
+        wl_surface_damage(surface, 0, 0, surface_width, surface_height);
+
+        bool frame_consumed{false};
+        surface.add_frame_callback([&frame_consumed](auto) { frame_consumed = true; });
+
+        auto const committed = std::chrono::steady_clock::now();
+        wl_surface_commit(surface);
+        client.dispatch_until([&frame_consumed]() { return frame_consumed; });
+        commit_to_frame.record(std::chrono::steady_clock::now() - committed);
+    }
+    auto const cpu_time = wlcs::helpers::process_cpu_time() - cpu_start;
+
+    auto const name = "transform_scale_" + std::to_string(scale) + "_" + transform_name(transform);
+    commit_to_frame.report(name + "_commit_to_frame");
+    wlcs::report_metric(
+        name + "_cpu_time_per_frame",
+        std::chrono::duration<double, std::micro>(cpu_time).count() / frame_count,
+        "us");
+    // Per buffer pixel, so that scales can be compared with each other
+    wlcs::report_metric(
+        name + "_cpu_time_per_megapixel",
+        std::chrono::duration<double, std::micro>(cpu_time).count() / frame_count /
+            (static_cast<double>(buffer_width) * buffer_height / 1e6),
+        "us");
+}
+
+INSTANTIATE_TEST_CASE_P(
+    ScalesAndTransforms,
+    BufferTransformTest,
+    Combine(
+        Values(1, 2, 3),
+        Values(
+            WL_OUTPUT_TRANSFORM_NORMAL,
+            WL_OUTPUT_TRANSFORM_90,
+            WL_OUTPUT_TRANSFORM_180,
+            WL_OUTPUT_TRANSFORM_270,
+            WL_OUTPUT_TRANSFORM_FLIPPED,
+            WL_OUTPUT_TRANSFORM_FLIPPED_90,
+            WL_OUTPUT_TRANSFORM_FLIPPED_180,
+            WL_OUTPUT_TRANSFORM_FLIPPED_270)));
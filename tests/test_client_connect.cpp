@@ -0,0 +1,174 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace testing;
+
+namespace
+{
+// As when a session starts, or a test harness spawns its clients
+int const client_count{200};
+
+int const output_width{640};
+int const output_height{480};
+// Outputs are the globals a server advertises many of, and the only ones we bind eagerly
+std::vector<int> const added_output_counts{0, 8, 32};
+
+/*
+ * Connect client_count clients, keeping them all connected, then time
+ * showing the first window of a few fresh clients. Returns the mean
+ * connect latency.
+ */
+std::chrono::steady_clock::duration measure_connects(wlcs::Server& server, std::string const& name)
+{
+    wlcs::LatencyRecorder connect;
+    wlcs::LatencyRecorder first_window;
+    std::vector<std::unique_ptr<wlcs::Client>> clients;
+    for (int i = 0; i < client_count; ++i)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        clients.push_back(std::make_unique<wlcs::Client>(server));
+        connect.record(std::chrono::steady_clock::now() - start);
+    }
+
+    // Binding the globals a window needs is part of showing a client's first one
+    for (int i = 0; i < 10; ++i)
+    {
+        wlcs::Client client{server};
+        auto const start = std::chrono::steady_clock::now();
+        client.create_visible_surface(100, 100);
+        first_window.record(std::chrono::steady_clock::now() - start);
+    }
+
+    connect.report(name + "_connect");
+    first_window.report(name + "_first_window");
+    return connect.mean();
+}
+}
+
+using ClientConnectTest = wlcs::InProcessServer;
+
+/*
+ * A client's connection cost shouldn't grow with the number of globals the
+ * server advertises beyond what the client actually binds. This only adds
+ * outputs, which are still bound on connect, so it measures the eager path;
+ * lazy_globals_defer_binding_cost below covers the rest.
+ */
+TEST_F(ClientConnectTest, connect_latency_as_advertised_globals_grow)
+{
+    std::vector<int> added_outputs;
+    std::chrono::steady_clock::duration baseline{0};
+
+    for (auto const count : added_output_counts)
+    {
+        while (static_cast<int>(added_outputs.size()) < count)
+        {
+            // Off to the side of any real outputs
+            auto const x = 10000 + static_cast<int>(added_outputs.size()) * output_width;
+            try
+            {
+                added_outputs.push_back(the_server().add_output(x, 0, output_width, output_height));
+            }
+            catch (wlcs::ShimNotImplemented const&)
+            {
+                skip("Shim does not implement wlcs_server_add_output");
+                return;
+            }
+        }
+
+        auto const name = "client_connect_" + std::to_string(count) + "_added_outputs";
+        auto const mean = measure_connects(the_server(), name);
+
+        if (count == 0)
+        {
+            baseline = mean;
+        }
+        else
+        {
+            wlcs::report_metric(
+                name + "_cost_per_eager_output",
+                std::chrono::duration<double, std::micro>(mean - baseline).count() / count,
+                "us");
+        }
+    }
+
+    for (auto const output : added_outputs)
+    {
+        the_server().remove_output(output);
+    }
+}
+
+/*
+ * Connecting binds only the outputs; the cost of the other globals moves to
+ * their first use. Time the first use of the globals that roundtrip when
+ * bound, and of every global a client might want, against the connect.
+ * Connect plus binding everything approximates the old eager connect.
+ */
+TEST_F(ClientConnectTest, lazy_globals_defer_binding_cost)
+{
+    wlcs::LatencyRecorder connect;
+    wlcs::LatencyRecorder first_shm;
+    wlcs::LatencyRecorder first_seat;
+    wlcs::LatencyRecorder remaining_globals;
+    wlcs::LatencyRecorder connect_and_bind_all;
+
+    for (int i = 0; i < client_count; ++i)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        wlcs::Client client{the_server()};
+        auto const connected = std::chrono::steady_clock::now();
+        client.shm();
+        auto const shm_bound = std::chrono::steady_clock::now();
+        client.seat();
+        auto const seat_bound = std::chrono::steady_clock::now();
+        client.compositor();
+        client.subcompositor();
+        client.xdg_shell();
+        client.linux_dmabuf();
+        client.presentation();
+        client.viewporter();
+        client.data_device_manager();
+        auto const all_bound = std::chrono::steady_clock::now();
+
+        connect.record(connected - start);
+        first_shm.record(shm_bound - connected);
+        first_seat.record(seat_bound - shm_bound);
+        remaining_globals.record(all_bound - seat_bound);
+        connect_and_bind_all.record(all_bound - start);
+    }
+
+    connect.report("client_connect_lazy_connect");
+    first_shm.report("client_connect_first_shm");
+    first_seat.report("client_connect_first_seat");
+    remaining_globals.report("client_connect_remaining_globals");
+    connect_and_bind_all.report("client_connect_and_bind_all_globals");
+
+    wlcs::report_metric(
+        "client_connect_deferred_by_lazy_binding",
+        std::chrono::duration<double, std::micro>(connect_and_bind_all.mean() - connect.mean()).count(),
+        "us");
+}
@@ -0,0 +1,422 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "helpers.h"
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <boost/throw_exception.hpp>
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace testing;
+
+namespace
+{
+char const* const mime_type = "application/x-wlcs-payload";
+int const surface_size{100};
+size_t const read_chunk{64 * 1024};
+// Below this the server buffering the payload wouldn't stand out from noise
+size_t const min_checked_payload{16 * 1024 * 1024};
+
+// Prime, so that the pattern doesn't line up with pages or pipe buffers
+unsigned char pattern_at(size_t offset)
+{
+    return static_cast<unsigned char>(offset % 251);
+}
+
+std::string size_name(size_t size)
+{
+    if (size >= 1024 * 1024)
+    {
+        return std::to_string(size / (1024 * 1024)) + "MiB";
+    }
+    return std::to_string(size / 1024) + "KiB";
+}
+
+struct SourceState
+{
+    int send_fd{-1};
+    bool cancelled{false};
+};
+
+void source_target(void*, wl_data_source*, char const*)
+{
+}
+
+void source_send(void* ctx, wl_data_source*, char const*, int32_t fd)
+{
+    static_cast<SourceState*>(ctx)->send_fd = fd;
+}
+
+void source_cancelled(void* ctx, wl_data_source*)
+{
+    static_cast<SourceState*>(ctx)->cancelled = true;
+}
+
+void source_dnd_drop_performed(void*, wl_data_source*)
+{
+}
+
+void source_dnd_finished(void*, wl_data_source*)
+{
+}
+
+void source_action(void*, wl_data_source*, uint32_t)
+{
+}
+
+wl_data_source_listener const source_listener = {
+    &source_target,
+    &source_send,
+    &source_cancelled,
+    &source_dnd_drop_performed,
+    &source_dnd_finished,
+    &source_action
+};
+
+struct ReceiverState
+{
+    std::map<wl_data_offer*, std::set<std::string>> offered_types;
+    wl_data_offer* selection{nullptr};
+};
+
+void offer_offer(void* ctx, wl_data_offer* offer, char const* type)
+{
+    static_cast<ReceiverState*>(ctx)->offered_types[offer].insert(type);
+}
+
+void offer_source_actions(void*, wl_data_offer*, uint32_t)
+{
+}
+
+void offer_action(void*, wl_data_offer*, uint32_t)
+{
+}
+
+wl_data_offer_listener const offer_listener = {
+    &offer_offer,
+    &offer_source_actions,
+    &offer_action
+};
+
+void device_data_offer(void* ctx, wl_data_device*, wl_data_offer* offer)
+{
+    static_cast<ReceiverState*>(ctx)->offered_types[offer];
+    wl_data_offer_add_listener(offer, &offer_listener, ctx);
+}
+
+void device_enter(void*, wl_data_device*, uint32_t, wl_surface*, wl_fixed_t, wl_fixed_t, wl_data_offer*)
+{
+}
+
+void device_leave(void*, wl_data_device*)
+{
+}
+
+void device_motion(void*, wl_data_device*, uint32_t, wl_fixed_t, wl_fixed_t)
+{
+}
+
+void device_drop(void*, wl_data_device*)
+{
+}
+
+void device_selection(void* ctx, wl_data_device*, wl_data_offer* offer)
+{
+    auto const me = static_cast<ReceiverState*>(ctx);
+    if (me->selection)
+    {
+        me->offered_types.erase(me->selection);
+        wl_data_offer_destroy(me->selection);
+    }
+    me->selection = offer;
+}
+
+wl_data_device_listener const device_listener = {
+    &device_data_offer,
+    &device_enter,
+    &device_leave,
+    &device_motion,
+    &device_drop,
+    &device_selection
+};
+
+bool selection_offers_payload(ReceiverState const& receiver)
+{
+    return receiver.selection &&
+        receiver.offered_types.at(receiver.selection).count(mime_type);
+}
+
+/// Taps a client's surfaces, listening for the touch down once for every tap
+class Tapper
+{
+public:
+    Tapper(wlcs::Client& client, wlcs::Touch& touch)
+        : client{client},
+          touch{touch},
+          state{std::make_shared<State>()}
+    {
+        client.add_touch_listener(
+            [state = state](wlcs::TouchEvent const& event)
+            {
+                if (event.type == wlcs::TouchEvent::Type::down && !state->touched)
+                {
+                    state->serial = event.serial;
+                    state->touched = true;
+                }
+            });
+    }
+
+    /// Touch the middle of a surface at (x, y) and return the serial of the touch down
+    uint32_t tap(int x, int y)
+    {
+        state->touched = false;
+
+        touch.down_at(0, x + surface_size / 2, y + surface_size / 2);
+        touch.frame();
+        touch.up(0);
+        touch.frame();
+
+        client.dispatch_until([this]() { return state->touched; });
+        return state->serial;
+    }
+
+private:
+    struct State
+    {
+        uint32_t serial{0};
+        bool touched{false};
+    };
+
+    wlcs::Client& client;
+    wlcs::Touch& touch;
+    // Shared with the listener, which lives as long as the client
+    std::shared_ptr<State> const state;
+};
+
+void write_payload(int fd, std::vector<unsigned char> const& payload)
+{
+    size_t written{0};
+    while (written < payload.size())
+    {
+        auto const result = write(fd, payload.data() + written, payload.size() - written);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        written += result;
+    }
+    close(fd);
+}
+}
+
+class ClipboardTransferTest :
+    public wlcs::InProcessServer,
+    public WithParamInterface<size_t>
+{
+};
+
+/*
+ * Copy a payload from one client to another through the selection. The
+ * server only passes the receiver's pipe on to the source; the data itself
+ * should flow straight between the clients, so the server's memory
+ * footprint shouldn't grow with the payload.
+ */
+TEST_P(ClipboardTransferTest, selection_throughput)
+{
+    auto const payload_size = GetParam();
+
+    wlcs::Client source_client{the_server()};
+    wlcs::Client receiver_client{the_server()};
+    if (!source_client.data_device_manager() || !source_client.seat())
+    {
+        skip("Server does not support wl_data_device_manager and wl_seat");
+        return;
+    }
+
+    auto source_surface = source_client.create_visible_surface(surface_size, surface_size);
+    auto receiver_surface = receiver_client.create_visible_surface(surface_size, surface_size);
+
+    // The source needs an input serial to set the selection, and the receiver focus to be offered it
+    std::unique_ptr<wlcs::Touch> touch;
+    try
+    {
+        the_server().move_surface_to(source_surface, 0, 0);
+        the_server().move_surface_to(receiver_surface, 2 * surface_size, 0);
+        touch = std::make_unique<wlcs::Touch>(the_server().create_touch());
+    }
+    catch (wlcs::ShimNotImplemented const&)
+    {
+        skip("Shim does not implement window positioning or the touch hooks");
+        return;
+    }
+
+    SourceState source_state;
+    // The source client is offered its own selection while it has focus
+    ReceiverState source_view;
+    auto const source_device =
+        wl_data_device_manager_get_data_device(source_client.data_device_manager(), source_client.seat());
+    wl_data_device_add_listener(source_device, &device_listener, &source_view);
+    auto const source = wl_data_device_manager_create_data_source(source_client.data_device_manager());
+    wl_data_source_add_listener(source, &source_listener, &source_state);
+    wl_data_source_offer(source, mime_type);
+
+    ReceiverState receiver_state;
+    auto const receiver_device =
+        wl_data_device_manager_get_data_device(receiver_client.data_device_manager(), receiver_client.seat());
+    wl_data_device_add_listener(receiver_device, &device_listener, &receiver_state);
+    receiver_client.roundtrip();
+
+    Tapper source_tapper{source_client, *touch};
+    Tapper receiver_tapper{receiver_client, *touch};
+    auto const serial = source_tapper.tap(0, 0);
+    wl_data_device_set_selection(source_device, source, serial);
+    source_client.roundtrip();
+    receiver_tapper.tap(2 * surface_size, 0);
+
+    if (!receiver_client.dispatch_until(
+        [&receiver_state]() { return selection_offers_payload(receiver_state); },
+        std::chrono::seconds{2}))
+    {
+        skip("Server did not offer the selection to the client touched last");
+    }
+    else
+    {
+        std::vector<unsigned char> payload(payload_size);
+        for (size_t i = 0; i < payload.size(); ++i)
+        {
+            payload[i] = pattern_at(i);
+        }
+
+        int pipe_fds[2];
+        if (pipe2(pipe_fds, O_CLOEXEC) == -1)
+        {
+            BOOST_THROW_EXCEPTION((std::system_error{errno, std::system_category(), "Failed to create pipe"}));
+        }
+
+        wlcs::helpers::reset_peak_resident_memory();
+        auto const baseline_memory = wlcs::helpers::resident_memory();
+
+        auto const start = std::chrono::steady_clock::now();
+        wl_data_offer_receive(receiver_state.selection, mime_type, pipe_fds[1]);
+        close(pipe_fds[1]);
+        receiver_client.roundtrip();
+        if (!source_client.dispatch_until(
+            [&source_state]() { return source_state.send_fd >= 0; },
+            std::chrono::seconds{2}))
+        {
+            close(pipe_fds[0]);
+            ADD_FAILURE() << "Server did not ask the source client to send the selection";
+        }
+        else
+        {
+            auto const send_latency = std::chrono::steady_clock::now() - start;
+
+            std::thread writer{[fd = source_state.send_fd, &payload]() { write_payload(fd, payload); }};
+
+            std::vector<unsigned char> chunk(read_chunk);
+            size_t received{0};
+            size_t mismatches{0};
+            ssize_t result;
+            while ((result = read(pipe_fds[0], chunk.data(), chunk.size())) != 0)
+            {
+                if (result < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    break;
+                }
+                for (ssize_t i = 0; i < result; ++i)
+                {
+                    if (chunk[i] != pattern_at(received + i))
+                    {
+                        ++mismatches;
+                    }
+                }
+                received += result;
+            }
+            writer.join();
+            auto const elapsed = std::chrono::steady_clock::now() - start;
+            close(pipe_fds[0]);
+
+            auto const memory_growth =
+                static_cast<double>(wlcs::helpers::peak_resident_memory()) - static_cast<double>(baseline_memory);
+
+            auto const name = "clipboard_" + size_name(payload_size);
+            wlcs::report_metric(
+                name + "_send_latency",
+                std::chrono::duration<double, std::micro>(send_latency).count(),
+                "us");
+            wlcs::report_metric(
+                name + "_transfer_time",
+                std::chrono::duration<double, std::milli>(elapsed).count(),
+                "ms");
+            wlcs::report_metric(
+                name + "_throughput",
+                received / std::chrono::duration<double>(elapsed).count() / (1024 * 1024),
+                "MiB/s");
+            wlcs::report_metric(name + "_peak_memory_growth", memory_growth / 1024, "KiB");
+
+            EXPECT_THAT(received, Eq(payload_size));
+            EXPECT_THAT(mismatches, Eq(0u)) << "Payload was corrupted in transit";
+            if (payload_size >= min_checked_payload)
+            {
+                EXPECT_THAT(memory_growth, Lt(payload_size / 2.0)) << "Server appears to buffer selection data";
+            }
+        }
+    }
+
+    for (auto const state : {&receiver_state, &source_view})
+    {
+        if (state->selection)
+        {
+            wl_data_offer_destroy(state->selection);
+        }
+    }
+    wl_data_device_destroy(receiver_device);
+    wl_data_source_destroy(source);
+    wl_data_device_destroy(source_device);
+}
+
+INSTANTIATE_TEST_CASE_P(
+    PayloadSizes,
+    ClipboardTransferTest,
+    Values(
+        size_t{1024},
+        size_t{64 * 1024},
+        size_t{1024 * 1024},
+        size_t{16 * 1024 * 1024},
+        size_t{256 * 1024 * 1024}));
@@ -0,0 +1,193 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "background_client.h"
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace testing;
+
+namespace
+{
+int const window_size{200};
+int const cursor_size{64};
+// Frames of the cursor animation, as in an animated "busy" cursor theme
+int const cursor_frames{8};
+std::chrono::seconds const run_time{3};
+// Servers may repaint the cursor plane without sending callbacks promptly
+std::chrono::milliseconds const callback_timeout{500};
+
+using Duration = std::chrono::steady_clock::duration;
+}
+
+class CursorAnimationTest :
+    public wlcs::InProcessServer,
+    public WithParamInterface<int>
+{
+};
+
+/*
+ * Animate a cursor surface at a target rate while another client renders
+ * continuously. A server that repaints the whole scene for every cursor
+ * frame, rather than just moving or updating a cursor plane, both limits
+ * the cursor's rate and delays the other client's frames.
+ */
+TEST_P(CursorAnimationTest, animated_cursor_rate_and_bystander_impact)
+{
+    auto const target_hz = GetParam();
+    auto const target_interval = std::chrono::duration_cast<Duration>(std::chrono::seconds{1}) / target_hz;
+
+    // Before connecting, as the seat only gains the pointer capability once there's a pointer
+    std::unique_ptr<wlcs::Pointer> pointer;
+    try
+    {
+        pointer = std::make_unique<wlcs::Pointer>(the_server().create_pointer());
+    }
+    catch (wlcs::ShimNotImplemented const&)
+    {
+        skip("Shim does not implement the pointer hooks");
+        return;
+    }
+
+    wlcs::Client client{the_server()};
+    if (!client.pointer())
+    {
+        skip("Server does not provide a pointer device");
+        return;
+    }
+
+    auto window = client.create_visible_surface(window_size, window_size);
+    try
+    {
+        the_server().move_surface_to(window, 0, 0);
+    }
+    catch (wlcs::ShimNotImplemented const&)
+    {
+        skip("Shim does not implement wlcs_server_position_window_absolute");
+        return;
+    }
+
+    auto const enter_serial = std::make_shared<uint32_t>(0);
+    auto const entered = std::make_shared<bool>(false);
+    client.add_pointer_listener(
+        [enter_serial, entered](wlcs::PointerEvent const& event)
+        {
+            if (event.type == wlcs::PointerEvent::Type::enter)
+            {
+                *enter_serial = event.serial;
+                *entered = true;
+            }
+        });
+
+    pointer->move_to(window_size / 2, window_size / 2);
+    client.dispatch_until([entered]() { return *entered; });
+
+    wlcs::Surface cursor{client};
+    std::vector<wlcs::ShmBuffer> cursor_buffers;
+    for (int i = 0; i < cursor_frames; ++i)
+    {
+        cursor_buffers.emplace_back(client, cursor_size, cursor_size);
+        memset(cursor_buffers.back().data(), 0x20 * i, static_cast<size_t>(cursor_buffers.back().stride()) * cursor_size);
+    }
+    wl_surface_attach(cursor, cursor_buffers.front(), 0, 0);
+    wl_surface_damage(cursor, 0, 0, cursor_size, cursor_size);
+    wl_surface_commit(cursor);
+    wl_pointer_set_cursor(client.pointer(), *enter_serial, cursor, cursor_size / 2, cursor_size / 2);
+    client.roundtrip();
+
+    wlcs::BackgroundClient bystander{the_server()};
+
+    // Let the bystander reach a steady state, and get a baseline
+    std::this_thread::sleep_for(std::chrono::milliseconds{200});
+    auto const baseline_start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(run_time);
+    auto const animation_start = std::chrono::steady_clock::now();
+
+    wlcs::LatencyRecorder cursor_latency;
+    int frames{0};
+    int stalls{0};
+    auto next_due = animation_start;
+    while (std::chrono::steady_clock::now() - animation_start < run_time)
+    {
+        std::this_thread::sleep_until(next_due);
+        next_due += target_interval;
+
+        wl_surface_attach(cursor, cursor_buffers[frames % cursor_frames], 0, 0);
+        wl_surface_damage(cursor, 0, 0, cursor_size, cursor_size);
+
+        // Shared, as a callback we give up waiting for may still arrive later
+        auto const frame_consumed = std::make_shared<bool>(false);
+        cursor.add_frame_callback([frame_consumed](auto) { *frame_consumed = true; });
+
+        auto const committed = std::chrono::steady_clock::now();
+        wl_surface_commit(cursor);
+        if (client.dispatch_until([frame_consumed]() { return *frame_consumed; }, callback_timeout))
+        {
+            cursor_latency.record(std::chrono::steady_clock::now() - committed);
+        }
+        else
+        {
+            ++stalls;
+        }
+        ++frames;
+
+        // If we've fallen behind, aim for the next slot rather than trying to catch up
+        auto const now = std::chrono::steady_clock::now();
+        if (next_due < now)
+        {
+            next_due = now + target_interval;
+        }
+    }
+    auto const animation_end = std::chrono::steady_clock::now();
+
+    bystander.stop();
+
+    auto const baseline = bystander.latency_between(baseline_start, animation_start);
+    auto const during_animation = bystander.latency_between(animation_start, animation_end);
+
+    auto const name = "cursor_" + std::to_string(target_hz) + "hz";
+    cursor_latency.report(name + "_commit_to_frame");
+    wlcs::report_metric(
+        name + "_achieved_rate",
+        frames / std::chrono::duration<double>(animation_end - animation_start).count(),
+        "frames/s");
+    wlcs::report_metric(name + "_callback_stalls", stalls, "stalls");
+    baseline.report(name + "_bystander_baseline_latency");
+    during_animation.report(name + "_bystander_latency");
+    if (baseline.count() > 0 && during_animation.count() > 0)
+    {
+        wlcs::report_metric(
+            name + "_bystander_latency_increase",
+            std::chrono::duration<double, std::micro>(during_animation.mean() - baseline.mean()).count(),
+            "us");
+    }
+}
+
+INSTANTIATE_TEST_CASE_P(
+    CursorRates,
+    CursorAnimationTest,
+    Values(60, 120, 144, 240));
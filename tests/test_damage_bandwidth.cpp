@@ -0,0 +1,240 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <vector>
+
+using namespace testing;
+
+namespace
+{
+int const buffer_width{3840};
+int const buffer_height{2160};
+int const frame_count{120};
+
+struct Rect
+{
+    int x, y, width, height;
+};
+
+enum class Damage
+{
+    small,      ///< A single 64x64 rectangle
+    scattered,  ///< 64 32x32 rectangles spread across the buffer
+    full        ///< The whole buffer
+};
+
+enum class Request
+{
+    surface,    ///< wl_surface.damage, in surface coordinates
+    buffer      ///< wl_surface.damage_buffer, in buffer coordinates
+};
+
+struct DamageParams
+{
+    Damage damage;
+    Request request;
+};
+
+std::ostream& operator<<(std::ostream& out, DamageParams const& params)
+{
+    switch (params.damage)
+    {
+    case Damage::small:
+        out << "small";
+        break;
+    case Damage::scattered:
+        out << "scattered";
+        break;
+    case Damage::full:
+        out << "full";
+        break;
+    }
+    return out << "_" << (params.request == Request::surface ? "surface" : "buffer");
+}
+
+std::vector<Rect> damage_for(Damage damage)
+{
+    switch (damage)
+    {
+    case Damage::small:
+        return {{buffer_width / 2, buffer_height / 2, 64, 64}};
+    case Damage::scattered:
+    {
+        std::vector<Rect> rects;
+        for (int row = 0; row < 8; ++row)
+        {
+            for (int column = 0; column < 8; ++column)
+            {
+                rects.push_back({
+                    column * buffer_width / 8 + row * 16,
+                    row * buffer_height / 8 + column * 16,
+                    32,
+                    32});
+            }
+        }
+        return rects;
+    }
+    case Damage::full:
+        break;
+    }
+    return {{0, 0, buffer_width, buffer_height}};
+}
+
+// Redraw only what we're about to damage, as a damage-tracking client would
+void fill(wlcs::ShmBuffer& buffer, Rect const& rect, uint32_t colour)
+{
+    for (int y = rect.y; y < rect.y + rect.height; ++y)
+    {
+        auto row = reinterpret_cast<uint32_t*>(static_cast<char*>(buffer.data()) + y * buffer.stride());
+        std::fill(row + rect.x, row + rect.x + rect.width, colour);
+    }
+}
+}
+
+class DamageBandwidthTest :
+    public wlcs::InProcessServer,
+    public WithParamInterface<DamageParams>
+{
+};
+
+/*
+ * A compositor that honours damage only needs to upload the damaged part of
+ * a buffer, so small damage should sustain a far higher frame rate than full
+ * damage. If the rates are similar, the compositor is uploading everything.
+ */
+TEST_P(DamageBandwidthTest, upload_rate_for_damage)
+{
+    auto const params = GetParam();
+
+    wlcs::Client client{the_server()};
+    auto surface = client.create_visible_surface(buffer_width, buffer_height);
+
+    if (params.request == Request::buffer &&
+        wl_surface_get_version(surface) < WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION)
+    {
+        skip("Server's wl_compositor does not support damage_buffer");
+        return;
+    }
+
+    // Double buffered, so we never draw into a buffer the compositor might be reading
+    std::vector<wlcs::ShmBuffer> buffers;
+    std::vector<bool> busy(2, false);
+    for (int i = 0; i < 2; ++i)
+    {
+        buffers.emplace_back(client, buffer_width, buffer_height);
+        fill(buffers.back(), {0, 0, buffer_width, buffer_height}, 0xff000000);
+        buffers.back().add_release_listener([&busy, i]() { busy[i] = false; return true; });
+    }
+
+    auto const damage = damage_for(params.damage);
+    size_t damaged_bytes{0};
+    for (auto const& rect : damage)
+    {
+        damaged_bytes += static_cast<size_t>(rect.width) * rect.height * 4;
+    }
+
+    auto const commit_frame =
+        [&](int i)
+        {
+            auto const index = i % 2;
+            client.dispatch_until([&busy, index]() { return !busy[index]; });
+
+            auto& buffer = buffers[index];
+            for (auto const& rect : damage)
+            {
+                fill(buffer, rect, 0xff000000 | (i * 0x010203));
+            }
+
+            wl_surface_attach(surface, buffer, 0, 0);
+            busy[index] = true;
+            for (auto const& rect : damage)
+            {
+                if (params.request == Request::buffer)
+                {
+                    wl_surface_damage_buffer(surface, rect.x, rect.y, rect.width, rect.height);
+                }
+                else
+                {
+                    wl_surface_damage(surface, rect.x, rect.y, rect.width, rect.height);
+                }
+            }
+
+            bool frame_consumed{false};
+            surface.add_frame_callback([&frame_consumed](auto) { frame_consumed = true; });
+
+            auto const committed = std::chrono::steady_clock::now();
+            wl_surface_commit(surface);
+            client.dispatch_until([&frame_consumed]() { return frame_consumed; });
+            return std::chrono::steady_clock::now() - committed;
+        };
+
+    // Both buffers get one full upload before we start measuring
+    for (int i = 0; i < 2; ++i)
+    {
+        wl_surface_attach(surface, buffers[i], 0, 0);
+        busy[i] = true;
+        wl_surface_damage(surface, 0, 0, buffer_width, buffer_height);
+
+        bool frame_consumed{false};
+        surface.add_frame_callback([&frame_consumed](auto) { frame_consumed = true; });
+        wl_surface_commit(surface);
+        client.dispatch_until([&frame_consumed]() { return frame_consumed; });
+    }
+
+    wlcs::LatencyRecorder commit_to_frame;
+    auto const start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frame_count; ++i)
+    {
+        commit_to_frame.record(commit_frame(i));
+    }
+    auto const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::ostringstream name;
+    name << "damage_" << params;
+    commit_to_frame.report(name.str() + "_commit_to_frame");
+    wlcs::report_metric(name.str() + "_frame_rate", frame_count / seconds, "frames/s");
+    wlcs::report_metric(
+        name.str() + "_damaged_bandwidth",
+        static_cast<double>(damaged_bytes) * frame_count / seconds / (1024 * 1024),
+        "MiB/s");
+}
+
+INSTANTIATE_TEST_CASE_P(
+    SurfaceDamage,
+    DamageBandwidthTest,
+    Values(
+        DamageParams{Damage::small, Request::surface},
+        DamageParams{Damage::scattered, Request::surface},
+        DamageParams{Damage::full, Request::surface}));
+
+INSTANTIATE_TEST_CASE_P(
+    BufferDamage,
+    DamageBandwidthTest,
+    Values(
+        DamageParams{Damage::small, Request::buffer},
+        DamageParams{Damage::scattered, Request::buffer},
+        DamageParams{Damage::full, Request::buffer}));
@@ -0,0 +1,94 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "dmabuf_buffer.h"
+#include "helpers.h"
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <cstring>
+#include <string>
+
+using namespace testing;
+
+namespace
+{
+int const buffer_width{1920};
+int const buffer_height{1080};
+int const frame_count{120};
+
+/*
+ * Show the same buffer repeatedly with full damage. The server is in this
+ * process, so process CPU time covers both its import and our client.
+ */
+template<typename Buffer>
+void measure_frames(wlcs::Client& client, Buffer& buffer, std::string const& name)
+{
+    auto surface = client.create_visible_surface(buffer_width, buffer_height);
+    memset(buffer.data(), 0x80, static_cast<size_t>(buffer.stride()) * buffer_height);
+
+    wlcs::LatencyRecorder commit_to_frame;
+    auto const cpu_start = wlcs::helpers::process_cpu_time();
+    for (int i = 0; i < frame_count; ++i)
+    {
+        wl_surface_attach(surface, buffer, 0, 0);
+        wl_surface_damage(surface, 0, 0, buffer_width, buffer_height);
+
+        bool frame_consumed{false};
+        surface.add_frame_callback([&frame_consumed](auto) { frame_consumed = true; });
+
+        auto const committed = std::chrono::steady_clock::now();
+        wl_surface_commit(surface);
+        client.dispatch_until([&frame_consumed]() { return frame_consumed; });
+        commit_to_frame.record(std::chrono::steady_clock::now() - committed);
+    }
+    auto const cpu_time = wlcs::helpers::process_cpu_time() - cpu_start;
+
+    commit_to_frame.report(name + "_commit_to_frame");
+    wlcs::report_metric(
+        name + "_cpu_time_per_frame",
+        std::chrono::duration<double, std::micro>(cpu_time).count() / frame_count,
+        "us");
+}
+}
+
+using DmabufImportTest = wlcs::InProcessServer;
+
+/*
+ * A dmabuf can be imported without copying, where an shm buffer has to be
+ * uploaded on every damaged commit; compare the two for the same content.
+ */
+TEST_F(DmabufImportTest, dmabuf_compared_to_shm)
+{
+    wlcs::Client client{the_server()};
+
+    if (!wlcs::DmabufBuffer::available(client))
+    {
+        skip("Server lacks linux-dmabuf ARGB8888 support, or /dev/udmabuf is unavailable");
+        return;
+    }
+
+    wlcs::ShmBuffer shm_buffer{client, buffer_width, buffer_height};
+    measure_frames(client, shm_buffer, "import_shm");
+
+    wlcs::DmabufBuffer dmabuf_buffer{client, buffer_width, buffer_height};
+    measure_frames(client, dmabuf_buffer, "import_dmabuf");
+}
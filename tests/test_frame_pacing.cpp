@@ -0,0 +1,152 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "helpers.h"
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace testing;
+
+namespace
+{
+int const surface_size{200};
+// Servers needn't repaint for a commit with no damage, so may not send its frame callback promptly
+std::chrono::milliseconds const callback_timeout{500};
+
+using Duration = std::chrono::steady_clock::duration;
+}
+
+class FramePacingTest :
+    public wlcs::InProcessServer,
+    public WithParamInterface<int>
+{
+};
+
+/*
+ * Render new content at a target rate, using frame callbacks as the clock
+ * as a video player or game would: on each callback, draw a new frame if
+ * one is due, and otherwise just ask for the next callback.
+ *
+ * A content frame arriving less than half an interval after the previous
+ * one was delivered twice in the same slot; one arriving more than one and
+ * a half intervals after it means a slot was skipped.
+ */
+TEST_P(FramePacingTest, sustained_pacing_at_target_rate)
+{
+    auto const target_hz = GetParam();
+    auto const run_time = std::chrono::seconds{wlcs::helpers::get_env_int("WLCS_PACING_SECONDS", 10)};
+    auto const target_interval = std::chrono::duration_cast<Duration>(std::chrono::seconds{1}) / target_hz;
+
+    wlcs::Client client{the_server()};
+    auto surface = client.create_visible_surface(surface_size, surface_size);
+    wlcs::ShmBuffer buffer{client, surface_size, surface_size};
+
+    std::vector<Duration> content_intervals;
+    int callbacks{0};
+    int stalls{0};
+
+    auto const start = std::chrono::steady_clock::now();
+    auto last_content = start;
+    auto next_due = start;
+    while (std::chrono::steady_clock::now() - start < run_time)
+    {
+        auto const now = std::chrono::steady_clock::now();
+        if (now >= next_due)
+        {
+            if (now != start)
+            {
+                content_intervals.push_back(now - last_content);
+            }
+            last_content = now;
+            next_due += target_interval;
+
+            // If we've fallen behind, aim for the next slot rather than trying to catch up
+            if (next_due < now)
+            {
+                next_due = now + target_interval;
+            }
+
+            wl_surface_attach(surface, buffer, 0, 0);
+            wl_surface_damage(surface, 0, 0, surface_size, surface_size);
+        }
+
+        // Shared, as a callback we give up waiting for may still arrive later
+        auto const frame_consumed = std::make_shared<bool>(false);
+        surface.add_frame_callback([frame_consumed](auto) { *frame_consumed = true; });
+        wl_surface_commit(surface);
+        if (client.dispatch_until([frame_consumed]() { return *frame_consumed; }, callback_timeout))
+        {
+            ++callbacks;
+        }
+        else
+        {
+            ++stalls;
+        }
+    }
+
+    ASSERT_THAT(content_intervals, Not(IsEmpty()));
+
+    wlcs::LatencyRecorder intervals;
+    int double_delivered{0};
+    int skipped{0};
+    double squared_error{0};
+    for (auto const interval : content_intervals)
+    {
+        intervals.record(interval);
+
+        if (interval < target_interval / 2)
+        {
+            ++double_delivered;
+        }
+        else if (interval > target_interval * 3 / 2)
+        {
+            skipped += static_cast<int>(std::round(static_cast<double>(interval.count()) / target_interval.count())) - 1;
+        }
+
+        auto const error = std::chrono::duration<double, std::micro>(interval - target_interval).count();
+        squared_error += error * error;
+    }
+
+    auto const name = "pacing_" + std::to_string(target_hz) + "hz";
+    intervals.report(name + "_content_interval");
+    wlcs::report_metric(
+        name + "_achieved_rate",
+        content_intervals.size() / std::chrono::duration<double>(run_time).count(),
+        "frames/s");
+    wlcs::report_metric(name + "_jitter", std::sqrt(squared_error / content_intervals.size()), "us");
+    wlcs::report_metric(name + "_double_delivered", double_delivered, "frames");
+    wlcs::report_metric(name + "_skipped", skipped, "frames");
+    wlcs::report_metric(
+        name + "_callback_rate",
+        callbacks / std::chrono::duration<double>(run_time).count(),
+        "callbacks/s");
+    wlcs::report_metric(name + "_callback_stalls", stalls, "stalls");
+}
+
+INSTANTIATE_TEST_CASE_P(
+    TargetRates,
+    FramePacingTest,
+    Values(30, 60, 120, 144));
@@ -0,0 +1,168 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "helpers.h"
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+
+using namespace testing;
+
+namespace
+{
+int const victim_size{200};
+int const victim_position{100};
+int const occluder_width{800};
+int const occluder_height{600};
+
+std::chrono::seconds const measurement_time{2};
+// A throttling server may hold a hidden surface's callback indefinitely
+std::chrono::milliseconds const callback_timeout{250};
+
+/*
+ * Redraw as fast as frame callbacks allow for a fixed time, as an animating
+ * client would, and return the rate at which callbacks arrived.
+ */
+double frame_callback_rate(wlcs::Client& client, wlcs::Surface& surface, wlcs::ShmBuffer& buffer)
+{
+    int callbacks{0};
+    auto const start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < measurement_time)
+    {
+        wl_surface_attach(surface, buffer, 0, 0);
+        wl_surface_damage(surface, 0, 0, victim_size, victim_size);
+
+        // Shared, as a callback we give up waiting for may still arrive later
+        auto const frame_consumed = std::make_shared<bool>(false);
+        surface.add_frame_callback([frame_consumed](auto) { *frame_consumed = true; });
+        wl_surface_commit(surface);
+
+        if (client.dispatch_until([frame_consumed]() { return *frame_consumed; }, callback_timeout))
+        {
+            ++callbacks;
+        }
+    }
+    return callbacks / std::chrono::duration<double>(measurement_time).count();
+}
+
+/*
+ * Enforce WLCS_HIDDEN_FRAME_CALLBACK_LIMIT (callbacks/s) if it's set. By
+ * default the rate is only reported, as the protocol allows servers to keep
+ * sending callbacks to hidden surfaces.
+ */
+void expect_throttled(double hidden_rate)
+{
+    auto const limit = wlcs::helpers::get_env_int("WLCS_HIDDEN_FRAME_CALLBACK_LIMIT", -1);
+    if (limit >= 0)
+    {
+        EXPECT_THAT(hidden_rate, Le(limit))
+            << "Hidden surface received more frame callbacks than WLCS_HIDDEN_FRAME_CALLBACK_LIMIT allows";
+    }
+}
+}
+
+using FrameThrottlingTest = wlcs::InProcessServer;
+
+TEST_F(FrameThrottlingTest, fully_occluded_surface)
+{
+    wlcs::Client client{the_server()};
+
+    auto victim = client.create_visible_surface(victim_size, victim_size);
+    wlcs::ShmBuffer victim_buffer{client, victim_size, victim_size};
+    wl_surface_attach(victim, victim_buffer, 0, 0);
+    wl_surface_damage(victim, 0, 0, victim_size, victim_size);
+    wl_surface_commit(victim);
+    try
+    {
+        the_server().move_surface_to(victim, victim_position, victim_position);
+    }
+    catch (wlcs::ShimNotImplemented const&)
+    {
+        skip("Shim does not implement wlcs_server_position_window_absolute");
+        return;
+    }
+    client.roundtrip();
+
+    auto const visible_rate = frame_callback_rate(client, victim, victim_buffer);
+
+    // Map an opaque window over the top of the victim
+    auto occluder = client.create_visible_surface(occluder_width, occluder_height);
+    wlcs::ShmBuffer occluder_buffer{client, occluder_width, occluder_height};
+
+    auto const opaque = wl_compositor_create_region(client.compositor());
+    wl_region_add(opaque, 0, 0, occluder_width, occluder_height);
+    wl_surface_set_opaque_region(occluder, opaque);
+    wl_region_destroy(opaque);
+
+    wl_surface_attach(occluder, occluder_buffer, 0, 0);
+    wl_surface_damage(occluder, 0, 0, occluder_width, occluder_height);
+    wl_surface_commit(occluder);
+    the_server().move_surface_to(occluder, 0, 0);
+    client.roundtrip();
+
+    auto const occluded_rate = frame_callback_rate(client, victim, victim_buffer);
+
+    wlcs::report_metric("throttling_visible_callback_rate", visible_rate, "callbacks/s");
+    wlcs::report_metric("throttling_occluded_callback_rate", occluded_rate, "callbacks/s");
+    expect_throttled(occluded_rate);
+}
+
+TEST_F(FrameThrottlingTest, surface_off_every_output)
+{
+    wlcs::Client client{the_server()};
+
+    auto victim = client.create_visible_surface(victim_size, victim_size);
+    wlcs::ShmBuffer victim_buffer{client, victim_size, victim_size};
+    wl_surface_attach(victim, victim_buffer, 0, 0);
+    wl_surface_damage(victim, 0, 0, victim_size, victim_size);
+    wl_surface_commit(victim);
+    try
+    {
+        the_server().move_surface_to(victim, victim_position, victim_position);
+    }
+    catch (wlcs::ShimNotImplemented const&)
+    {
+        skip("Shim does not implement wlcs_server_position_window_absolute");
+        return;
+    }
+    client.roundtrip();
+
+    auto const visible_rate = frame_callback_rate(client, victim, victim_buffer);
+
+    // Well beyond the right hand edge of the rightmost output
+    int off_screen_x{10000};
+    for (auto const& output : client.outputs())
+    {
+        off_screen_x = std::max(off_screen_x, output.x + output.width + 1000);
+    }
+    the_server().move_surface_to(victim, off_screen_x, victim_position);
+    client.roundtrip();
+
+    auto const off_output_rate = frame_callback_rate(client, victim, victim_buffer);
+
+    wlcs::report_metric("throttling_visible_callback_rate", visible_rate, "callbacks/s");
+    wlcs::report_metric("throttling_off_output_callback_rate", off_output_rate, "callbacks/s");
+    wlcs::report_metric("throttling_off_output_entered_outputs", victim.current_outputs().size(), "outputs");
+    expect_throttled(off_output_rate);
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "helpers.h"
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace testing;
+
+namespace
+{
+int const fresh_buffer_count{5};
+int const reuse_frame_count{30};
+
+// Mappings the server may legitimately keep around, such as a cached pool
+int const mapping_slack{4};
+
+struct ImportParams
+{
+    char const* name;
+    int width;
+    int height;
+    uint32_t format;
+};
+
+std::ostream& operator<<(std::ostream& out, ImportParams const& params)
+{
+    return out << params.name;
+}
+
+std::chrono::steady_clock::duration commit_and_wait_for_frame(
+    wlcs::Client& client,
+    wlcs::Surface& surface,
+    wlcs::ShmBuffer& buffer,
+    int width,
+    int height)
+{
+    wl_surface_attach(surface, buffer, 0, 0);
+    wl_surface_damage(surface, 0, 0, width, height);
+
+    bool frame_consumed{false};
+    surface.add_frame_callback([&frame_consumed](auto) { frame_consumed = true; });
+
+    auto const committed = std::chrono::steady_clock::now();
+    wl_surface_commit(surface);
+    client.dispatch_until([&frame_consumed]() { return frame_consumed; });
+    return std::chrono::steady_clock::now() - committed;
+}
+}
+
+class LargeBufferImportTest :
+    public wlcs::InProcessServer,
+    public WithParamInterface<ImportParams>
+{
+};
+
+/*
+ * The first time the server sees a buffer it must map it and upload all of
+ * it; a buffer it has seen before should be cheaper. A server that copies
+ * every shm buffer in full every frame shows up as reuse costing as much as
+ * a first import, and as peak memory well beyond the buffers themselves.
+ */
+TEST_P(LargeBufferImportTest, first_import_and_reuse)
+{
+    auto const params = GetParam();
+    auto const buffer_size = static_cast<size_t>(params.width) * 4 * params.height;
+
+    auto const baseline_mappings = wlcs::helpers::memory_mapping_count();
+    auto const baseline_memory = wlcs::helpers::resident_memory();
+    wlcs::helpers::reset_peak_resident_memory();
+
+    wlcs::LatencyRecorder first_import;
+    wlcs::LatencyRecorder reuse;
+    {
+        wlcs::Client client{the_server()};
+        auto surface = client.create_visible_surface(params.width, params.height);
+
+        std::vector<std::unique_ptr<wlcs::ShmBuffer>> buffers;
+        for (int i = 0; i < fresh_buffer_count; ++i)
+        {
+            buffers.push_back(
+                std::make_unique<wlcs::ShmBuffer>(client, params.width, params.height, params.format));
+            memset(buffers.back()->data(), 0xff, buffer_size);
+
+            first_import.record(
+                commit_and_wait_for_frame(client, surface, *buffers.back(), params.width, params.height));
+        }
+
+        // Keep every buffer alive, so reuse only ever sees buffers the server has imported
+        for (int i = 0; i < reuse_frame_count; ++i)
+        {
+            reuse.record(
+                commit_and_wait_for_frame(
+                    client, surface, *buffers[i % buffers.size()], params.width, params.height));
+        }
+    }
+
+    // Our own buffers account for fresh_buffer_count of this; the rest is the server's
+    auto const peak_growth =
+        static_cast<double>(wlcs::helpers::peak_resident_memory()) - static_cast<double>(baseline_memory);
+
+    // The server tidies up after the client asynchronously
+    auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+    while (std::chrono::steady_clock::now() < deadline &&
+           wlcs::helpers::memory_mapping_count() > baseline_mappings + mapping_slack)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    auto const mapping_growth = wlcs::helpers::memory_mapping_count() - baseline_mappings;
+
+    std::ostringstream name;
+    name << "large_buffer_" << params;
+    first_import.report(name.str() + "_first_import_to_frame");
+    reuse.report(name.str() + "_reuse_to_frame");
+    wlcs::report_metric(name.str() + "_peak_memory_growth", peak_growth / (1024 * 1024), "MiB");
+    wlcs::report_metric(
+        name.str() + "_peak_memory_growth_in_buffers",
+        peak_growth / buffer_size,
+        "buffers");
+    wlcs::report_metric(name.str() + "_mapping_growth", mapping_growth, "mappings");
+
+    EXPECT_THAT(mapping_growth, Le(mapping_slack))
+        << "Server kept shm mappings after the client and its buffers were destroyed";
+}
+
+INSTANTIATE_TEST_CASE_P(
+    UHD,
+    LargeBufferImportTest,
+    Values(
+        ImportParams{"3840x2160_argb8888", 3840, 2160, WL_SHM_FORMAT_ARGB8888},
+        ImportParams{"3840x2160_xrgb8888", 3840, 2160, WL_SHM_FORMAT_XRGB8888}));
+
+INSTANTIATE_TEST_CASE_P(
+    FUHD,
+    LargeBufferImportTest,
+    Values(
+        ImportParams{"7680x4320_argb8888", 7680, 4320, WL_SHM_FORMAT_ARGB8888},
+        ImportParams{"7680x4320_xrgb8888", 7680, 4320, WL_SHM_FORMAT_XRGB8888}));
@@ -0,0 +1,159 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "helpers.h"
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace testing;
+
+namespace
+{
+int const clutter_layers{16};
+int const frame_count{120};
+
+struct Cost
+{
+    std::chrono::steady_clock::duration mean_latency;
+    std::chrono::nanoseconds cpu_time_per_frame;
+};
+
+/*
+ * Stack clutter_layers full-screen windows on the first output, with a
+ * full-screen "video" window on top of them all, then animate the video.
+ * The content is the same translucent colour either way; only the opaque
+ * region tells the server it needn't draw what's underneath.
+ */
+Cost measure_stack(wlcs::Server& server, bool opaque, std::string const& name)
+{
+    wlcs::Client client{server};
+
+    int x{0}, y{0}, width{1024}, height{768};
+    auto const outputs = client.outputs();
+    if (!outputs.empty())
+    {
+        x = outputs.front().x;
+        y = outputs.front().y;
+        width = outputs.front().width;
+        height = outputs.front().height;
+    }
+
+    std::vector<wlcs::Surface> layers;
+    std::vector<wlcs::ShmBuffer> buffers;
+    for (int i = 0; i < clutter_layers + 1; ++i)
+    {
+        buffers.emplace_back(client, width, height);
+        memset(buffers.back().data(), 0xcc, static_cast<size_t>(buffers.back().stride()) * height);
+
+        layers.push_back(client.create_visible_surface(width, height));
+        auto& layer = layers.back();
+
+        if (opaque)
+        {
+            auto const region = wl_compositor_create_region(client.compositor());
+            wl_region_add(region, 0, 0, width, height);
+            wl_surface_set_opaque_region(layer, region);
+            wl_region_destroy(region);
+        }
+
+        wl_surface_attach(layer, buffers.back(), 0, 0);
+        wl_surface_damage(layer, 0, 0, width, height);
+        wl_surface_commit(layer);
+        server.move_surface_to(layer, x, y);
+    }
+    client.roundtrip();
+
+    auto& video = layers.back();
+    auto& video_buffer = buffers.back();
+
+    wlcs::LatencyRecorder commit_to_frame;
+    auto const cpu_start = wlcs::helpers::process_cpu_time();
+    for (int i = 0; i < frame_count; ++i)
+    {
+        wl_surface_attach(video, video_buffer, 0, 0);
+        wl_surface_damage(video, 0, 0, width, height);
+
+        bool frame_consumed{false};
+        video.add_frame_callback([&frame_consumed](auto) { frame_consumed = true; });
+
+        auto const committed = std::chrono::steady_clock::now();
+        wl_surface_commit(video);
+        client.dispatch_until([&frame_consumed]() { return frame_consumed; });
+        commit_to_frame.record(std::chrono::steady_clock::now() - committed);
+    }
+    auto const cpu_time_per_frame = (wlcs::helpers::process_cpu_time() - cpu_start) / frame_count;
+
+    commit_to_frame.report(name + "_commit_to_frame");
+    wlcs::report_metric(
+        name + "_cpu_time_per_frame",
+        std::chrono::duration<double, std::micro>(cpu_time_per_frame).count(),
+        "us");
+
+    return {commit_to_frame.mean(), cpu_time_per_frame};
+}
+}
+
+using OpaqueOcclusionTest = wlcs::InProcessServer;
+
+/*
+ * A server that culls surfaces hidden behind opaque regions only has to
+ * composite the top window of the opaque stack, while without opaque
+ * regions it must blend every layer. Compare the cost of the two.
+ */
+TEST_F(OpaqueOcclusionTest, opaque_regions_compared_to_translucent_stack)
+{
+    Cost translucent;
+    Cost opaque;
+    try
+    {
+        translucent = measure_stack(the_server(), false, "occlusion_translucent");
+        opaque = measure_stack(the_server(), true, "occlusion_opaque");
+    }
+    catch (wlcs::ShimNotImplemented const&)
+    {
+        skip("Shim does not implement wlcs_server_position_window_absolute");
+        return;
+    }
+
+    if (translucent.cpu_time_per_frame.count() > 0)
+    {
+        auto const percent_saved =
+            100.0 * (translucent.cpu_time_per_frame - opaque.cpu_time_per_frame).count() /
+                translucent.cpu_time_per_frame.count();
+        wlcs::report_metric("occlusion_cpu_time_saved", percent_saved, "%");
+
+        // Culling is an optimisation the protocol doesn't require, so only expect it if asked to
+        auto const minimum = wlcs::helpers::get_env_int("WLCS_OCCLUSION_MIN_CPU_SAVED_PERCENT", -1);
+        if (minimum >= 0)
+        {
+            EXPECT_THAT(percent_saved, Ge(minimum))
+                << "Opaque regions saved less CPU time than WLCS_OCCLUSION_MIN_CPU_SAVED_PERCENT requires";
+        }
+    }
+    wlcs::report_metric(
+        "occlusion_latency_saved",
+        std::chrono::duration<double, std::micro>(translucent.mean_latency - opaque.mean_latency).count(),
+        "us");
+}
@@ -0,0 +1,219 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "helpers.h"
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <deque>
+#include <vector>
+
+using namespace testing;
+
+namespace
+{
+int const surface_size{64};
+int const surface_columns{8};
+int const surface_rows{4};
+int const surface_spacing{200};
+
+int const output_width{640};
+int const output_height{480};
+int const max_added_outputs{4};
+
+int const rounds{5};
+int const changes_per_round{100};
+
+std::chrono::seconds const convergence_timeout{5};
+
+struct Placement
+{
+    int x;
+    int y;
+};
+
+bool overlaps(wlcs::OutputState const& output, Placement const& surface)
+{
+    return !(output.x >= surface.x + surface_size
+        || output.x + output.width <= surface.x
+        || output.y >= surface.y + surface_size
+        || output.y + output.height <= surface.y);
+}
+
+/*
+ * The client's view has converged once it has seen every output we expect,
+ * and every surface has entered exactly those outputs it overlaps.
+ */
+bool client_view_converged(
+    wlcs::Client& client,
+    std::vector<wlcs::Surface> const& surfaces,
+    std::vector<Placement> const& placements,
+    size_t expected_output_count)
+{
+    auto const outputs = client.outputs();
+    if (outputs.size() != expected_output_count)
+    {
+        return false;
+    }
+
+    for (auto i = 0u; i < surfaces.size(); ++i)
+    {
+        std::set<uint32_t> expected;
+        for (auto const& output : outputs)
+        {
+            if (overlaps(output, placements[i]))
+            {
+                expected.insert(output.name);
+            }
+        }
+
+        if (surfaces[i].current_outputs() != expected)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+using OutputHotplugTest = wlcs::InProcessServer;
+
+TEST_F(OutputHotplugTest, surface_outputs_converge_after_hotplug_storm)
+{
+    // Check the shim can hotplug outputs before relying on it
+    try
+    {
+        auto const probe = the_server().add_output(0, 0, output_width, output_height);
+        the_server().move_output(probe, output_width, 0);
+        the_server().remove_output(probe);
+    }
+    catch (wlcs::ShimNotImplemented const&)
+    {
+        skip("Shim does not implement the output hotplug hooks");
+        return;
+    }
+
+    wlcs::Client client{the_server()};
+
+    auto const initial_output_count = client.outputs().size();
+
+    std::vector<wlcs::Surface> surfaces;
+    std::vector<wlcs::ShmBuffer> buffers;
+    std::vector<Placement> placements;
+    for (int row = 0; row < surface_rows; ++row)
+    {
+        for (int column = 0; column < surface_columns; ++column)
+        {
+            surfaces.push_back(client.create_visible_surface(surface_size, surface_size));
+            buffers.emplace_back(client, surface_size, surface_size);
+            placements.push_back(Placement{column * surface_spacing + 10, row * surface_spacing + 10});
+
+            auto& surface = surfaces.back();
+            wl_surface_attach(surface, buffers.back(), 0, 0);
+            wl_surface_damage(surface, 0, 0, surface_size, surface_size);
+            wl_surface_commit(surface);
+
+            try
+            {
+                the_server().move_surface_to(surface, placements.back().x, placements.back().y);
+            }
+            catch (wlcs::ShimNotImplemented const&)
+            {
+                skip("Shim does not implement wlcs_server_position_window_absolute");
+                return;
+            }
+        }
+    }
+    client.roundtrip();
+
+    auto const wait_for_convergence =
+        [&](size_t expected_output_count)
+        {
+            auto const start = std::chrono::steady_clock::now();
+            while (!client_view_converged(client, surfaces, placements, expected_output_count))
+            {
+                if (std::chrono::steady_clock::now() - start > convergence_timeout)
+                {
+                    ADD_FAILURE() << "Surface output membership failed to converge";
+                    break;
+                }
+                client.roundtrip();
+            }
+            return std::chrono::steady_clock::now() - start;
+        };
+
+    wlcs::LatencyRecorder storm_convergence;
+    wlcs::LatencyRecorder unplug_convergence;
+    std::vector<size_t> resident_memory_after_round;
+
+    for (int round = 0; round < rounds; ++round)
+    {
+        std::deque<int> added_outputs;
+
+        for (int change = 0; change < changes_per_round; ++change)
+        {
+            int const x = (change % 5) * (output_width / 2);
+            int const y = (change % 3) * (output_height / 2);
+
+            switch (change % 3)
+            {
+            case 0:
+                if (added_outputs.size() < max_added_outputs)
+                {
+                    added_outputs.push_back(the_server().add_output(x, y, output_width, output_height));
+                }
+                break;
+            case 1:
+                if (!added_outputs.empty())
+                {
+                    the_server().move_output(added_outputs.back(), x, y);
+                }
+                break;
+            case 2:
+                if (added_outputs.size() > 1)
+                {
+                    the_server().remove_output(added_outputs.front());
+                    added_outputs.pop_front();
+                }
+                break;
+            }
+        }
+
+        storm_convergence.record(wait_for_convergence(initial_output_count + added_outputs.size()));
+
+        for (auto const output : added_outputs)
+        {
+            the_server().remove_output(output);
+        }
+        unplug_convergence.record(wait_for_convergence(initial_output_count));
+
+        resident_memory_after_round.push_back(wlcs::helpers::resident_memory());
+    }
+
+    storm_convergence.report("hotplug_storm_convergence");
+    unplug_convergence.report("unplug_convergence");
+
+    auto const growth =
+        static_cast<double>(resident_memory_after_round.back()) -
+        static_cast<double>(resident_memory_after_round.front());
+    wlcs::report_metric("resident_memory_after_first_round", resident_memory_after_round.front() / 1024.0, "KiB");
+    wlcs::report_metric("resident_memory_growth_per_round", growth / (rounds - 1) / 1024.0, "KiB");
+}
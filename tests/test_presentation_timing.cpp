@@ -0,0 +1,165 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "in_process_server.h"
+#include "metrics.h"
+#include "presentation-time-client-protocol.h"
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <vector>
+
+#include <time.h>
+
+using namespace testing;
+
+namespace
+{
+int const frame_count{300};
+int const surface_size{400};
+
+std::chrono::nanoseconds now_on(clockid_t clock)
+{
+    timespec now;
+    clock_gettime(clock, &now);
+    return std::chrono::seconds{now.tv_sec} + std::chrono::nanoseconds{now.tv_nsec};
+}
+
+struct FrameRecord
+{
+    std::chrono::nanoseconds committed;
+    bool complete;
+    wlcs::PresentationFeedback feedback;
+};
+}
+
+using PresentationTimingTest = wlcs::InProcessServer;
+
+/*
+ * Commit as fast as frame callbacks allow, asking for presentation feedback
+ * each time. Presentation feedback says when each frame actually reached
+ * the screen, and on which vblank, so unlike frame callbacks it shows the
+ * true latency and any refreshes we missed.
+ */
+TEST_F(PresentationTimingTest, commit_to_present_latency_and_missed_vblanks)
+{
+    wlcs::Client client{the_server()};
+    if (!client.presentation())
+    {
+        skip("Server does not support wp_presentation");
+        return;
+    }
+
+    auto surface = client.create_visible_surface(surface_size, surface_size);
+    wlcs::ShmBuffer buffer{client, surface_size, surface_size};
+    auto const clock = client.presentation_clock();
+
+    std::vector<FrameRecord> frames(frame_count);
+    for (int i = 0; i < frame_count; ++i)
+    {
+        wl_surface_attach(surface, buffer, 0, 0);
+        wl_surface_damage(surface, 0, 0, surface_size, surface_size);
+
+        auto& frame = frames[i];
+        surface.add_presentation_feedback(
+            [&frame](wlcs::PresentationFeedback const& feedback)
+            {
+                frame.complete = true;
+                frame.feedback = feedback;
+            });
+
+        bool frame_consumed{false};
+        surface.add_frame_callback([&frame_consumed](auto) { frame_consumed = true; });
+
+        frame.committed = now_on(clock);
+        wl_surface_commit(surface);
+        client.dispatch_until([&frame_consumed]() { return frame_consumed; });
+    }
+
+    // Feedback for the last frames may trail their frame callbacks
+    client.dispatch_until(
+        [&frames]() { return frames.back().complete; },
+        std::chrono::seconds{5});
+
+    wlcs::LatencyRecorder commit_to_present;
+    wlcs::LatencyRecorder refresh_interval;
+    int presented{0};
+    int discarded{0};
+    int missing{0};
+    int missed_vblanks{0};
+    int vsync{0}, hw_clock{0}, hw_completion{0}, zero_copy{0};
+    FrameRecord const* previous{nullptr};
+
+    for (auto const& frame : frames)
+    {
+        if (!frame.complete)
+        {
+            ++missing;
+            continue;
+        }
+        if (!frame.feedback.presented)
+        {
+            ++discarded;
+            continue;
+        }
+
+        ++presented;
+        commit_to_present.record(
+            std::chrono::duration_cast<wlcs::LatencyRecorder::Duration>(
+                frame.feedback.timestamp - frame.committed));
+        if (frame.feedback.refresh.count() > 0)
+        {
+            refresh_interval.record(
+                std::chrono::duration_cast<wlcs::LatencyRecorder::Duration>(frame.feedback.refresh));
+        }
+
+        auto const flags = frame.feedback.flags;
+        if (flags & WP_PRESENTATION_FEEDBACK_KIND_VSYNC) ++vsync;
+        if (flags & WP_PRESENTATION_FEEDBACK_KIND_HW_CLOCK) ++hw_clock;
+        if (flags & WP_PRESENTATION_FEEDBACK_KIND_HW_COMPLETION) ++hw_completion;
+        if (flags & WP_PRESENTATION_FEEDBACK_KIND_ZERO_COPY) ++zero_copy;
+
+        // Each frame was committed as soon as the last was shown, so each should land on the next vblank
+        if (previous && frame.feedback.sequence > previous->feedback.sequence + 1)
+        {
+            missed_vblanks += frame.feedback.sequence - previous->feedback.sequence - 1;
+        }
+        previous = &frame;
+    }
+
+    commit_to_present.report("presentation_commit_to_present");
+    refresh_interval.report("presentation_refresh_interval");
+    wlcs::report_metric("presentation_frames_presented", presented, "frames");
+    wlcs::report_metric("presentation_frames_discarded", discarded, "frames");
+    wlcs::report_metric("presentation_feedback_missing", missing, "frames");
+    wlcs::report_metric("presentation_missed_vblanks", missed_vblanks, "vblanks");
+    if (presented > 0)
+    {
+        wlcs::report_metric(
+            "presentation_missed_vblank_rate",
+            100.0 * missed_vblanks / (presented + missed_vblanks),
+            "%");
+    }
+    wlcs::report_metric("presentation_vsync_frames", vsync, "frames");
+    wlcs::report_metric("presentation_hw_clock_frames", hw_clock, "frames");
+    wlcs::report_metric("presentation_hw_completion_frames", hw_completion, "frames");
+    wlcs::report_metric("presentation_zero_copy_frames", zero_copy, "frames");
+
+    EXPECT_THAT(missing, Eq(0)) << "Server never sent presented or discarded for some commits";
+}
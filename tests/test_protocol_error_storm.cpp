@@ -0,0 +1,317 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "background_client.h"
+#include "helpers.h"
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <boost/throw_exception.hpp>
+#include <gmock/gmock.h>
+#include <wayland-version.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace testing;
+
+namespace
+{
+int const surface_size{100};
+int const stride{surface_size * 4};
+int const pool_size{stride * surface_size};
+// How long to wait for an error before deciding the server let the request through
+std::chrono::seconds const error_timeout{1};
+
+/*
+ * Sends a request the server must reject, then returns a function that
+ * releases the client-side objects once the error has arrived (or not).
+ * The surface is null unless the case asks for one.
+ */
+using Trigger = std::function<std::function<void()>(wlcs::Client&, wlcs::Surface*)>;
+
+struct ErrorCase
+{
+    char const* name;
+    wl_interface const* interface;
+    /// The errors the protocol allows for the request
+    std::vector<uint32_t> codes;
+    uint32_t min_surface_version;
+    /// Whether the trigger needs a mapped surface to send its request on
+    bool needs_surface;
+    bool needs_subcompositor;
+    Trigger trigger;
+};
+
+wl_shm_pool* create_pool(wlcs::Client& client, int size)
+{
+    auto const fd = wlcs::helpers::create_anonymous_file(pool_size);
+    auto const pool = wl_shm_create_pool(client.shm(), fd, size);
+    close(fd);
+    return pool;
+}
+
+std::function<void()> truncated_shm_file(wlcs::Client& client, wlcs::Surface* surface)
+{
+    auto const fd = wlcs::helpers::create_anonymous_file(pool_size);
+    auto const pool = wl_shm_create_pool(client.shm(), fd, pool_size);
+    auto const buffer =
+        wl_shm_pool_create_buffer(pool, 0, surface_size, surface_size, stride, WL_SHM_FORMAT_ARGB8888);
+    wl_shm_pool_destroy(pool);
+
+    // The server will hit SIGBUS when it reads the buffer
+    if (ftruncate(fd, 12) == -1)
+    {
+        BOOST_THROW_EXCEPTION((std::system_error{errno, std::system_category(), "Failed to truncate shm file"}));
+    }
+    close(fd);
+
+    wl_surface_attach(*surface, buffer, 0, 0);
+    wl_surface_damage(*surface, 0, 0, surface_size, surface_size);
+    wl_surface_commit(*surface);
+
+    return [buffer]() { wl_buffer_destroy(buffer); };
+}
+
+std::function<void()> unmappable_pool_fd(wlcs::Client& client, wlcs::Surface*)
+{
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) == -1)
+    {
+        BOOST_THROW_EXCEPTION((std::system_error{errno, std::system_category(), "Failed to create pipe"}));
+    }
+    auto const pool = wl_shm_create_pool(client.shm(), pipe_fds[0], pool_size);
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+
+    return [pool]() { wl_shm_pool_destroy(pool); };
+}
+
+std::function<void()> zero_size_pool(wlcs::Client& client, wlcs::Surface*)
+{
+    auto const pool = create_pool(client, 0);
+    return [pool]() { wl_shm_pool_destroy(pool); };
+}
+
+std::function<void()> invalid_stride(wlcs::Client& client, wlcs::Surface*)
+{
+    auto const pool = create_pool(client, pool_size);
+    auto const buffer =
+        wl_shm_pool_create_buffer(pool, 0, surface_size, surface_size, stride / 2, WL_SHM_FORMAT_ARGB8888);
+    return [pool, buffer]()
+        {
+            wl_buffer_destroy(buffer);
+            wl_shm_pool_destroy(pool);
+        };
+}
+
+std::function<void()> invalid_format(wlcs::Client& client, wlcs::Surface*)
+{
+    auto const pool = create_pool(client, pool_size);
+    // A fourcc no server will ever advertise
+    auto const buffer = wl_shm_pool_create_buffer(pool, 0, surface_size, surface_size, stride, 0xdeadbeef);
+    return [pool, buffer]()
+        {
+            wl_buffer_destroy(buffer);
+            wl_shm_pool_destroy(pool);
+        };
+}
+
+std::function<void()> invalid_scale(wlcs::Client&, wlcs::Surface* surface)
+{
+    wl_surface_set_buffer_scale(*surface, 0);
+    wl_surface_commit(*surface);
+    return []() {};
+}
+
+std::function<void()> invalid_transform(wlcs::Client&, wlcs::Surface* surface)
+{
+    wl_surface_set_buffer_transform(*surface, 42);
+    wl_surface_commit(*surface);
+    return []() {};
+}
+
+std::function<void()> subsurface_of_itself(wlcs::Client& client, wlcs::Surface*)
+{
+    auto const surface = wl_compositor_create_surface(client.compositor());
+    auto const subsurface = wl_subcompositor_get_subsurface(client.subcompositor(), surface, surface);
+    return [surface, subsurface]()
+        {
+            wl_subsurface_destroy(subsurface);
+            wl_surface_destroy(surface);
+        };
+}
+
+std::vector<uint32_t> const subsurface_of_itself_codes{
+    WL_SUBCOMPOSITOR_ERROR_BAD_SURFACE,
+#if WAYLAND_VERSION_MAJOR > 1 || WAYLAND_VERSION_MINOR >= 22
+    // Later versions of the protocol have a more specific error for a bad parent
+    WL_SUBCOMPOSITOR_ERROR_BAD_PARENT,
+#endif
+};
+
+std::vector<ErrorCase> const error_cases{
+    {"truncated_shm_file", &wl_buffer_interface, {WL_SHM_ERROR_INVALID_FD}, 1, true, false, &truncated_shm_file},
+    {"unmappable_pool_fd", &wl_shm_interface, {WL_SHM_ERROR_INVALID_FD}, 1, false, false, &unmappable_pool_fd},
+    // wl_shm has no error for a bad pool size, so libwayland uses invalid_stride
+    {"zero_size_pool", &wl_shm_interface, {WL_SHM_ERROR_INVALID_STRIDE}, 1, false, false, &zero_size_pool},
+    {"invalid_stride", &wl_shm_pool_interface, {WL_SHM_ERROR_INVALID_STRIDE}, 1, false, false, &invalid_stride},
+    {"invalid_format", &wl_shm_pool_interface, {WL_SHM_ERROR_INVALID_FORMAT}, 1, false, false, &invalid_format},
+    {"invalid_scale", &wl_surface_interface, {WL_SURFACE_ERROR_INVALID_SCALE}, 3, true, false, &invalid_scale},
+    {"invalid_transform", &wl_surface_interface, {WL_SURFACE_ERROR_INVALID_TRANSFORM}, 2, true, false, &invalid_transform},
+    {"subsurface_of_itself", &wl_subcompositor_interface, subsurface_of_itself_codes, 1, false, true, &subsurface_of_itself}
+};
+
+struct CaseResults
+{
+    int matched{0};
+    int misclassified{0};
+    int not_raised{0};
+    std::string last_mismatch;
+    wlcs::LatencyRecorder request_to_error;
+};
+}
+
+using ProtocolErrorStormTest = wlcs::InProcessServer;
+
+/*
+ * Connect clients as fast as possible, each of which sends a different
+ * invalid request, and check each gets the error the protocol calls for.
+ * Meanwhile a well-behaved client keeps rendering; tearing down all the
+ * failed clients mustn't stall it.
+ */
+TEST_F(ProtocolErrorStormTest, each_error_is_classified_and_bystander_keeps_rendering)
+{
+    auto const client_count = wlcs::helpers::get_env_int("WLCS_ERROR_STORM_CLIENTS", 800);
+
+    std::vector<ErrorCase const*> cases;
+    {
+        wlcs::Client probe{the_server()};
+        auto surface = probe.create_visible_surface(surface_size, surface_size);
+        for (auto const& error_case : error_cases)
+        {
+            if (wl_surface_get_version(surface) < error_case.min_surface_version)
+            {
+                skip(std::string{"Server's wl_surface is too old for "} + error_case.name);
+            }
+            else if (error_case.needs_subcompositor && !probe.subcompositor())
+            {
+                skip(std::string{"Server has no wl_subcompositor for "} + error_case.name);
+            }
+            else
+            {
+                cases.push_back(&error_case);
+            }
+        }
+    }
+    std::vector<CaseResults> results(cases.size());
+
+    wlcs::BackgroundClient bystander{the_server()};
+
+    // Let the bystander reach a steady state, and get a baseline
+    std::this_thread::sleep_for(std::chrono::milliseconds{200});
+    auto const baseline_start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds{500});
+    auto const storm_start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < client_count; ++i)
+    {
+        auto const& error_case = *cases[i % cases.size()];
+        auto& result = results[i % cases.size()];
+
+        // The server disconnects a client on error, so each needs a new client
+        wlcs::Client client{the_server()};
+        std::unique_ptr<wlcs::Surface> surface;
+        if (error_case.needs_surface)
+        {
+            surface = std::make_unique<wlcs::Surface>(client.create_visible_surface(surface_size, surface_size));
+        }
+
+        auto const sent = std::chrono::steady_clock::now();
+        auto const release = error_case.trigger(client, surface.get());
+        try
+        {
+            client.dispatch_until([]() { return false; }, error_timeout);
+            ++result.not_raised;
+        }
+        catch (wlcs::ProtocolError const& error)
+        {
+            result.request_to_error.record(std::chrono::steady_clock::now() - sent);
+            auto const& codes = error_case.codes;
+            if (error.interface() == error_case.interface &&
+                std::find(codes.begin(), codes.end(), error.error_code()) != codes.end())
+            {
+                ++result.matched;
+            }
+            else
+            {
+                ++result.misclassified;
+                result.last_mismatch = error.what();
+            }
+        }
+        release();
+    }
+
+    auto const storm_end = std::chrono::steady_clock::now();
+    bystander.stop();
+
+    auto const baseline = bystander.latency_between(baseline_start, storm_start);
+    auto const during_storm = bystander.latency_between(storm_start, storm_end);
+
+    int errors_handled{0};
+    for (auto i = 0u; i < cases.size(); ++i)
+    {
+        auto const& result = results[i];
+        auto const name = std::string{"error_storm_"} + cases[i]->name;
+        result.request_to_error.report(name + "_request_to_error");
+        wlcs::report_metric(name + "_misclassified", result.misclassified, "clients");
+        wlcs::report_metric(name + "_not_raised", result.not_raised, "clients");
+        errors_handled += result.matched + result.misclassified;
+
+        EXPECT_THAT(result.not_raised, Eq(0)) << cases[i]->name << " was accepted without a protocol error";
+        EXPECT_THAT(result.misclassified, Eq(0))
+            << cases[i]->name << " raised the wrong error, such as: " << result.last_mismatch;
+    }
+
+    wlcs::report_metric(
+        "error_storm_errors_per_second",
+        errors_handled / std::chrono::duration<double>(storm_end - storm_start).count(),
+        "errors/s");
+    baseline.report("error_storm_bystander_baseline_latency");
+    during_storm.report("error_storm_bystander_latency_during_storm");
+
+    ASSERT_THAT(during_storm.count(), Gt(0u)) << "Bystander rendered no frames during the storm";
+
+    auto const latency_limit = wlcs::helpers::get_env_int("WLCS_ERROR_STORM_LATENCY_LIMIT_MS", -1);
+    if (latency_limit >= 0)
+    {
+        EXPECT_THAT(
+            std::chrono::duration_cast<std::chrono::milliseconds>(during_storm.max()).count(),
+            Le(latency_limit))
+            << "Bystander frame latency exceeded WLCS_ERROR_STORM_LATENCY_LIMIT_MS during the storm";
+    }
+}
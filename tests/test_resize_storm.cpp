@@ -0,0 +1,295 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "in_process_server.h"
+#include "metrics.h"
+#include "xdg-shell-client-protocol.h"
+
+#include <gmock/gmock.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using namespace testing;
+
+namespace
+{
+int const slot_count{3};
+int const frame_count{500};
+
+int const resize_max_width{800};
+int const resize_max_height{600};
+
+/*
+ * Hands out buffers of arbitrary size carved from a fixed set of slots in
+ * a single shm pool, so resizing never allocates new shared memory. A slot
+ * is only reused once the compositor has released the buffer in it.
+ */
+class PooledBuffers
+{
+public:
+    PooledBuffers(wlcs::Client& client, int max_width, int max_height)
+        : client{client},
+          max_width{max_width},
+          max_height{max_height},
+          slot_size{static_cast<size_t>(max_width * 4 * max_height)},
+          pool{client, slot_size * slot_count},
+          slots(slot_count)
+    {
+    }
+
+    wl_buffer* acquire(int width, int height)
+    {
+        width = std::min(width, max_width);
+        height = std::min(height, max_height);
+
+        auto free_slot = find_free_slot();
+        if (free_slot == slots.end())
+        {
+            ++stalls;
+            client.dispatch_until([this, &free_slot]() { return (free_slot = find_free_slot()) != slots.end(); });
+        }
+
+        auto& slot = *free_slot;
+        if (!slot.buffer || slot.width != width || slot.height != height)
+        {
+            // Released, so the compositor is done with the old buffer in this slot
+            slot.buffer = std::make_unique<wlcs::ShmBuffer>(
+                pool,
+                slot_size * (free_slot - slots.begin()),
+                width,
+                height);
+            slot.width = width;
+            slot.height = height;
+            slot.buffer->add_release_listener([&slot]() { slot.busy = false; return true; });
+            ++buffers_created;
+        }
+        else
+        {
+            ++buffers_reused;
+        }
+
+        slot.busy = true;
+        return *slot.buffer;
+    }
+
+    int buffers_created{0};
+    int buffers_reused{0};
+    int stalls{0};
+
+private:
+    struct Slot
+    {
+        std::unique_ptr<wlcs::ShmBuffer> buffer;
+        int width{0};
+        int height{0};
+        bool busy{false};
+    };
+
+    std::vector<Slot>::iterator find_free_slot()
+    {
+        return std::find_if(slots.begin(), slots.end(), [](Slot const& slot) { return !slot.busy; });
+    }
+
+    wlcs::Client& client;
+    int const max_width;
+    int const max_height;
+    size_t const slot_size;
+    wlcs::ShmPool pool;
+    std::vector<Slot> slots;
+};
+
+/*
+ * Drive the surface as fast as frame callbacks allow, as a client animating
+ * a resize would, attaching a buffer of size_for_frame(i) on frame i.
+ * Returns the commit to frame callback latency, and appends the interval
+ * between consecutive frame callbacks to intervals.
+ */
+wlcs::LatencyRecorder run_frame_loop(
+    wlcs::Client& client,
+    wlcs::Surface& surface,
+    PooledBuffers& buffers,
+    std::function<std::pair<int, int>(int)> const& size_for_frame,
+    std::vector<std::chrono::steady_clock::duration>& intervals)
+{
+    wlcs::LatencyRecorder commit_to_frame;
+    auto last_frame = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < frame_count; ++i)
+    {
+        auto const size = size_for_frame(i);
+        wl_surface_attach(surface, buffers.acquire(size.first, size.second), 0, 0);
+        wl_surface_damage(surface, 0, 0, size.first, size.second);
+
+        bool frame_consumed{false};
+        surface.add_frame_callback([&frame_consumed](auto) { frame_consumed = true; });
+
+        auto const committed = std::chrono::steady_clock::now();
+        wl_surface_commit(surface);
+        client.dispatch_until([&frame_consumed]() { return frame_consumed; });
+
+        auto const now = std::chrono::steady_clock::now();
+        commit_to_frame.record(now - committed);
+        intervals.push_back(now - last_frame);
+        last_frame = now;
+    }
+
+    return commit_to_frame;
+}
+
+std::chrono::steady_clock::duration median(std::vector<std::chrono::steady_clock::duration> samples)
+{
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    return samples[samples.size() / 2];
+}
+}
+
+using ResizeStormTest = wlcs::InProcessServer;
+
+TEST_F(ResizeStormTest, client_initiated_buffer_resizes)
+{
+    wlcs::Client client{the_server()};
+    auto surface = client.create_visible_surface(resize_max_width, resize_max_height);
+    PooledBuffers buffers{client, resize_max_width, resize_max_height};
+
+    // First, the frame rate the compositor sustains when nothing changes size
+    std::vector<std::chrono::steady_clock::duration> steady_intervals;
+    run_frame_loop(
+        client, surface, buffers,
+        [](int) { return std::make_pair(resize_max_width, resize_max_height); },
+        steady_intervals);
+    auto const reference_interval = median(steady_intervals);
+
+    std::vector<std::chrono::steady_clock::duration> resize_intervals;
+    auto const start = std::chrono::steady_clock::now();
+    auto const commit_to_frame = run_frame_loop(
+        client, surface, buffers,
+        [](int i)
+        {
+            return std::make_pair(
+                200 + (i * 37) % (resize_max_width - 200),
+                150 + (i * 53) % (resize_max_height - 150));
+        },
+        resize_intervals);
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+
+    // A frame is dropped if it took noticeably longer than a steady-state frame
+    auto const dropped_frames = std::count_if(
+        resize_intervals.begin(),
+        resize_intervals.end(),
+        [reference_interval](auto interval) { return interval > reference_interval * 3 / 2; });
+
+    commit_to_frame.report("resize_commit_to_frame");
+    wlcs::report_metric(
+        "resizes_per_second",
+        frame_count / std::chrono::duration<double>(elapsed).count(),
+        "resizes/s");
+    wlcs::report_metric("resize_dropped_frames", dropped_frames, "frames");
+    wlcs::report_metric("resize_buffers_created", buffers.buffers_created, "buffers");
+    wlcs::report_metric("resize_buffers_reused", buffers.buffers_reused, "buffers");
+    wlcs::report_metric("resize_release_stalls", buffers.stalls, "stalls");
+}
+
+TEST_F(ResizeStormTest, compositor_initiated_configure_resizes)
+{
+    wlcs::Client client{the_server()};
+    if (!client.xdg_shell())
+    {
+        skip("Server does not support xdg_wm_base");
+        return;
+    }
+
+    // Maximised windows can be as large as the largest output
+    int max_width{1920};
+    int max_height{1080};
+    for (auto const& output : client.outputs())
+    {
+        max_width = std::max(max_width, output.width);
+        max_height = std::max(max_height, output.height);
+    }
+
+    wlcs::Surface surface{client};
+    wlcs::XdgToplevel toplevel{surface};
+    PooledBuffers buffers{client, max_width, max_height};
+
+    bool configured{false};
+    int32_t width{0}, height{0};
+    uint32_t serial{0};
+    toplevel.add_configure_listener(
+        [&](int32_t configured_width, int32_t configured_height, uint32_t configured_serial)
+        {
+            configured = true;
+            width = configured_width > 0 ? configured_width : 400;
+            height = configured_height > 0 ? configured_height : 300;
+            serial = configured_serial;
+        });
+
+    wlcs::LatencyRecorder configure_latency;
+    wlcs::LatencyRecorder ack_to_frame;
+    auto const respond_to_configure =
+        [&](std::chrono::steady_clock::time_point requested)
+        {
+            client.dispatch_until([&configured]() { return configured; });
+            auto const configure_received = std::chrono::steady_clock::now();
+            configured = false;
+
+            toplevel.ack_configure(serial);
+            wl_surface_attach(surface, buffers.acquire(width, height), 0, 0);
+            wl_surface_damage(surface, 0, 0, width, height);
+
+            bool frame_consumed{false};
+            surface.add_frame_callback([&frame_consumed](auto) { frame_consumed = true; });
+            wl_surface_commit(surface);
+            client.dispatch_until([&frame_consumed]() { return frame_consumed; });
+
+            configure_latency.record(configure_received - requested);
+            ack_to_frame.record(std::chrono::steady_clock::now() - configure_received);
+        };
+
+    wl_surface_commit(surface);
+    respond_to_configure(std::chrono::steady_clock::now());
+
+    auto const start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frame_count; ++i)
+    {
+        auto const requested = std::chrono::steady_clock::now();
+        if (i % 2 == 0)
+        {
+            xdg_toplevel_set_maximized(toplevel);
+        }
+        else
+        {
+            xdg_toplevel_unset_maximized(toplevel);
+        }
+        respond_to_configure(requested);
+    }
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+
+    configure_latency.report("configure_latency");
+    ack_to_frame.report("configure_ack_to_frame");
+    wlcs::report_metric(
+        "configure_resizes_per_second",
+        frame_count / std::chrono::duration<double>(elapsed).count(),
+        "resizes/s");
+    wlcs::report_metric("configure_buffers_created", buffers.buffers_created, "buffers");
+    wlcs::report_metric("configure_release_stalls", buffers.stalls, "stalls");
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+using namespace testing;
+
+namespace
+{
+int const buffer_width{1920};
+int const buffer_height{1080};
+int const import_count{5};
+int const composite_frame_count{60};
+
+struct KnownFormat
+{
+    uint32_t format;
+    char const* name;
+};
+
+KnownFormat const known_formats[] = {
+    {WL_SHM_FORMAT_ARGB8888, "argb8888"},
+    {WL_SHM_FORMAT_XRGB8888, "xrgb8888"},
+    {WL_SHM_FORMAT_ABGR8888, "abgr8888"},
+    {WL_SHM_FORMAT_XBGR8888, "xbgr8888"},
+    {WL_SHM_FORMAT_RGBA8888, "rgba8888"},
+    {WL_SHM_FORMAT_RGBX8888, "rgbx8888"},
+    {WL_SHM_FORMAT_BGRA8888, "bgra8888"},
+    {WL_SHM_FORMAT_BGRX8888, "bgrx8888"},
+    {WL_SHM_FORMAT_ARGB2101010, "argb2101010"},
+    {WL_SHM_FORMAT_XRGB2101010, "xrgb2101010"},
+    {WL_SHM_FORMAT_ABGR2101010, "abgr2101010"},
+    {WL_SHM_FORMAT_XBGR2101010, "xbgr2101010"},
+    {WL_SHM_FORMAT_RGB888, "rgb888"},
+    {WL_SHM_FORMAT_BGR888, "bgr888"},
+    {WL_SHM_FORMAT_RGB565, "rgb565"},
+    {WL_SHM_FORMAT_BGR565, "bgr565"},
+    {WL_SHM_FORMAT_ARGB4444, "argb4444"},
+    {WL_SHM_FORMAT_XRGB4444, "xrgb4444"},
+    {WL_SHM_FORMAT_ARGB1555, "argb1555"},
+    {WL_SHM_FORMAT_XRGB1555, "xrgb1555"},
+    {WL_SHM_FORMAT_RGB332, "rgb332"},
+};
+
+std::chrono::steady_clock::duration commit_and_wait_for_frame(
+    wlcs::Client& client,
+    wlcs::Surface& surface,
+    wlcs::ShmBuffer& buffer)
+{
+    wl_surface_attach(surface, buffer, 0, 0);
+    wl_surface_damage(surface, 0, 0, buffer_width, buffer_height);
+
+    bool frame_consumed{false};
+    surface.add_frame_callback([&frame_consumed](auto) { frame_consumed = true; });
+
+    auto const committed = std::chrono::steady_clock::now();
+    wl_surface_commit(surface);
+    client.dispatch_until([&frame_consumed]() { return frame_consumed; });
+    return std::chrono::steady_clock::now() - committed;
+}
+}
+
+using ShmFormatTest = wlcs::InProcessServer;
+
+TEST_F(ShmFormatTest, server_advertises_required_formats)
+{
+    wlcs::Client client{the_server()};
+
+    EXPECT_THAT(client.shm_formats(), Contains(WL_SHM_FORMAT_ARGB8888));
+    EXPECT_THAT(client.shm_formats(), Contains(WL_SHM_FORMAT_XRGB8888));
+}
+
+/*
+ * Formats the server can't sample from directly must be converted on
+ * import, and again every time the buffer is damaged. Compare each format
+ * the server advertises against ARGB8888 to find the slow paths.
+ */
+TEST_F(ShmFormatTest, import_and_composite_cost_per_format)
+{
+    wlcs::Client client{the_server()};
+    auto const advertised = client.shm_formats();
+
+    for (auto const& known : known_formats)
+    {
+        if (advertised.count(known.format) == 0)
+        {
+            continue;
+        }
+
+        auto surface = client.create_visible_surface(buffer_width, buffer_height);
+
+        wlcs::LatencyRecorder import;
+        for (int i = 0; i < import_count; ++i)
+        {
+            wlcs::ShmBuffer buffer{client, buffer_width, buffer_height, known.format};
+            memset(buffer.data(), 0x80, static_cast<size_t>(buffer.stride()) * buffer_height);
+            import.record(commit_and_wait_for_frame(client, surface, buffer));
+        }
+
+        wlcs::ShmBuffer buffer{client, buffer_width, buffer_height, known.format};
+        memset(buffer.data(), 0x80, static_cast<size_t>(buffer.stride()) * buffer_height);
+        commit_and_wait_for_frame(client, surface, buffer);
+
+        wlcs::LatencyRecorder composite;
+        for (int i = 0; i < composite_frame_count; ++i)
+        {
+            composite.record(commit_and_wait_for_frame(client, surface, buffer));
+        }
+
+        std::string const name{std::string{"shm_format_"} + known.name};
+        import.report(name + "_import_to_frame");
+        composite.report(name + "_damaged_commit_to_frame");
+    }
+
+    for (auto const format : advertised)
+    {
+        auto const is_known = std::any_of(
+            std::begin(known_formats),
+            std::end(known_formats),
+            [format](KnownFormat const& known) { return known.format == format; });
+
+        if (!is_known)
+        {
+            std::cout << "Not benchmarking advertised format 0x" << std::hex << format << std::dec << std::endl;
+        }
+    }
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "helpers.h"
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <cstring>
+#include <ostream>
+#include <string>
+
+#include <sys/resource.h>
+
+using namespace testing;
+
+namespace
+{
+int const buffer_width{3840};
+int const buffer_height{2160};
+int const import_count{10};
+int const frame_count{60};
+
+struct BackingParams
+{
+    char const* name;
+    unsigned int file_flags;
+};
+
+std::ostream& operator<<(std::ostream& out, BackingParams const& params)
+{
+    return out << params.name;
+}
+
+long minor_faults()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+/*
+ * Page faults the server takes while importing or sampling the buffer. With
+ * huge pages one fault maps 2MiB rather than 4KiB, and the TLB covers the
+ * buffer in a few hundred entries rather than thousands, so both the fault
+ * count and the time spent should drop.
+ */
+struct FrameCost
+{
+    std::chrono::steady_clock::duration time;
+    long faults;
+};
+
+FrameCost commit_and_wait_for_frame(wlcs::Client& client, wlcs::Surface& surface, wlcs::ShmBuffer& buffer)
+{
+    wl_surface_attach(surface, buffer, 0, 0);
+    wl_surface_damage(surface, 0, 0, buffer_width, buffer_height);
+
+    bool frame_consumed{false};
+    surface.add_frame_callback([&frame_consumed](auto) { frame_consumed = true; });
+
+    auto const faults_before = minor_faults();
+    auto const committed = std::chrono::steady_clock::now();
+    wl_surface_commit(surface);
+    client.dispatch_until([&frame_consumed]() { return frame_consumed; });
+
+    return {std::chrono::steady_clock::now() - committed, minor_faults() - faults_before};
+}
+}
+
+class ShmPageBackingTest :
+    public wlcs::InProcessServer,
+    public WithParamInterface<BackingParams>
+{
+};
+
+TEST_P(ShmPageBackingTest, import_and_sampling_cost)
+{
+    auto const params = GetParam();
+    auto const buffer_size = static_cast<size_t>(buffer_width) * 4 * buffer_height;
+
+    wlcs::Client client{the_server()};
+    auto surface = client.create_visible_surface(buffer_width, buffer_height);
+
+    wlcs::LatencyRecorder import;
+    long import_faults{0};
+    for (int i = 0; i < import_count; ++i)
+    {
+        wlcs::ShmPool pool{client, buffer_size, params.file_flags};
+        if ((params.file_flags & wlcs::helpers::anonymous_file_huge_pages) && !pool.huge_pages())
+        {
+            skip("No free huge pages (see /proc/sys/vm/nr_hugepages)");
+            return;
+        }
+        if ((params.file_flags & wlcs::helpers::anonymous_file_seal_shrink) && !pool.sealed())
+        {
+            skip("Shm files can't be sealed on this system");
+            return;
+        }
+
+        wlcs::ShmBuffer buffer{pool, 0, buffer_width, buffer_height};
+        memset(buffer.data(), 0x80, buffer_size);
+
+        auto const cost = commit_and_wait_for_frame(client, surface, buffer);
+        import.record(cost.time);
+        import_faults += cost.faults;
+    }
+
+    wlcs::ShmPool pool{client, buffer_size, params.file_flags};
+    wlcs::ShmBuffer buffer{pool, 0, buffer_width, buffer_height};
+    memset(buffer.data(), 0x80, buffer_size);
+    commit_and_wait_for_frame(client, surface, buffer);
+
+    wlcs::LatencyRecorder sampling;
+    long sampling_faults{0};
+    for (int i = 0; i < frame_count; ++i)
+    {
+        auto const cost = commit_and_wait_for_frame(client, surface, buffer);
+        sampling.record(cost.time);
+        sampling_faults += cost.faults;
+    }
+
+    std::string const name{std::string{"shm_backing_"} + params.name};
+    import.report(name + "_import_to_frame");
+    sampling.report(name + "_damaged_commit_to_frame");
+    wlcs::report_metric(name + "_faults_per_import", static_cast<double>(import_faults) / import_count, "faults");
+    wlcs::report_metric(name + "_faults_per_frame", static_cast<double>(sampling_faults) / frame_count, "faults");
+}
+
+INSTANTIATE_TEST_CASE_P(
+    Backing,
+    ShmPageBackingTest,
+    Values(
+        BackingParams{"normal_pages", wlcs::helpers::anonymous_file_default},
+        BackingParams{"huge_pages", wlcs::helpers::anonymous_file_huge_pages},
+        BackingParams{"sealed", wlcs::helpers::anonymous_file_seal_shrink},
+        BackingParams{
+            "huge_pages_sealed",
+            wlcs::helpers::anonymous_file_huge_pages | wlcs::helpers::anonymous_file_seal_shrink}));
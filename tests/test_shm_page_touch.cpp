@@ -0,0 +1,144 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "helpers.h"
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+using namespace testing;
+
+namespace
+{
+int const buffer_width{1920};
+int const buffer_height{1080};
+
+struct DamageCase
+{
+    char const* name;
+    int x, y, width, height;
+};
+
+std::ostream& operator<<(std::ostream& out, DamageCase const& damage)
+{
+    return out << damage.name;
+}
+
+void fill(wlcs::ShmBuffer& buffer, DamageCase const& rect, uint32_t colour)
+{
+    for (int y = rect.y; y < rect.y + rect.height; ++y)
+    {
+        auto row = reinterpret_cast<uint32_t*>(static_cast<char*>(buffer.data()) + y * buffer.stride());
+        std::fill(row + rect.x, row + rect.x + rect.width, colour);
+    }
+}
+
+void commit_and_wait_for_frame(wlcs::Client& client, wlcs::Surface& surface)
+{
+    bool frame_consumed{false};
+    surface.add_frame_callback([&frame_consumed](auto) { frame_consumed = true; });
+    wl_surface_commit(surface);
+    client.dispatch_until([&frame_consumed]() { return frame_consumed; });
+}
+}
+
+class ShmPageTouchTest :
+    public wlcs::InProcessServer,
+    public WithParamInterface<DamageCase>
+{
+};
+
+/*
+ * The server shares our address space and our memfd, so we can see which
+ * buffer pages it reads: discard the buffer's pages, redraw only the damaged
+ * region, then commit. Any other page that becomes resident was faulted in
+ * by the server reading it.
+ *
+ * Pages we redraw are already resident, so reads of the damaged region
+ * itself can't be seen; what this measures is reading beyond the damage.
+ */
+TEST_P(ShmPageTouchTest, server_reads_only_damaged_pages)
+{
+    auto const damage = GetParam();
+
+    wlcs::Client client{the_server()};
+    auto surface = client.create_visible_surface(buffer_width, buffer_height);
+    wlcs::ShmBuffer buffer{client, buffer_width, buffer_height};
+    auto const buffer_size = static_cast<size_t>(buffer.stride()) * buffer_height;
+
+    // Let the server import the whole buffer once, as it would any new buffer
+    fill(buffer, {"full", 0, 0, buffer_width, buffer_height}, 0xff000000);
+    wl_surface_attach(surface, buffer, 0, 0);
+    wl_surface_damage(surface, 0, 0, buffer_width, buffer_height);
+    commit_and_wait_for_frame(client, surface);
+
+    wlcs::helpers::discard_pages(buffer.data(), buffer_size);
+    fill(buffer, damage, 0xffffffff);
+    auto const drawn = wlcs::helpers::resident_pages(buffer.data(), buffer_size);
+
+    wl_surface_attach(surface, buffer, 0, 0);
+    wl_surface_damage(surface, damage.x, damage.y, damage.width, damage.height);
+    commit_and_wait_for_frame(client, surface);
+    client.roundtrip();
+
+    auto const resident = wlcs::helpers::resident_pages(buffer.data(), buffer_size);
+
+    auto const drawn_pages = std::count(drawn.begin(), drawn.end(), true);
+    int read_beyond_damage{0};
+    for (auto i = 0u; i < resident.size(); ++i)
+    {
+        if (resident[i] && !drawn[i])
+        {
+            ++read_beyond_damage;
+        }
+    }
+
+    auto const undamaged_pages = static_cast<double>(resident.size() - drawn_pages);
+    std::string const name{std::string{"page_touch_"} + damage.name};
+    wlcs::report_metric(name + "_buffer_pages", resident.size(), "pages");
+    wlcs::report_metric(name + "_damaged_pages", drawn_pages, "pages");
+    wlcs::report_metric(name + "_pages_read_beyond_damage", read_beyond_damage, "pages");
+    if (undamaged_pages > 0)
+    {
+        auto const percent_read = read_beyond_damage / undamaged_pages * 100;
+        wlcs::report_metric(name + "_undamaged_fraction_read", percent_read, "%");
+
+        // Servers may legitimately upload more than the damage, so only enforce a limit if asked to
+        auto const limit = wlcs::helpers::get_env_int("WLCS_UNDAMAGED_READ_LIMIT_PERCENT", -1);
+        if (limit >= 0)
+        {
+            EXPECT_THAT(percent_read, Le(limit))
+                << "Server read more undamaged pages than WLCS_UNDAMAGED_READ_LIMIT_PERCENT allows";
+        }
+    }
+}
+
+INSTANTIATE_TEST_CASE_P(
+    Damage,
+    ShmPageTouchTest,
+    Values(
+        DamageCase{"small_rect", 928, 508, 64, 64},
+        DamageCase{"horizontal_band", 0, 512, buffer_width, 56},
+        DamageCase{"vertical_band", 928, 0, 64, buffer_height},
+        DamageCase{"full", 0, 0, buffer_width, buffer_height}));
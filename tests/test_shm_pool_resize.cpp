@@ -0,0 +1,129 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "helpers.h"
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+using namespace testing;
+
+namespace
+{
+int const buffer_width{256};
+int const buffer_height{64};
+int const stride{buffer_width * 4};
+size_t const buffer_size{static_cast<size_t>(stride) * buffer_height};
+// Grow by a page at a time, as a terminal gaining scrollback might
+size_t const growth{4096};
+
+// Mappings the server may legitimately keep, such as a cached pool
+int const mapping_slack{4};
+
+std::chrono::steady_clock::duration show_buffer(
+    wlcs::Client& client,
+    wlcs::Surface& surface,
+    wlcs::ShmBuffer& buffer)
+{
+    wl_surface_attach(surface, buffer, 0, 0);
+    wl_surface_damage(surface, 0, 0, buffer_width, buffer_height);
+
+    bool frame_consumed{false};
+    surface.add_frame_callback([&frame_consumed](auto) { frame_consumed = true; });
+
+    auto const committed = std::chrono::steady_clock::now();
+    wl_surface_commit(surface);
+    client.dispatch_until([&frame_consumed]() { return frame_consumed; });
+    return std::chrono::steady_clock::now() - committed;
+}
+}
+
+using ShmPoolResizeTest = wlcs::InProcessServer;
+
+/*
+ * Grow a pool while a buffer from it is attached, then show a buffer of the
+ * same size at the new end of the pool, so that each commit costs the same
+ * and only the resize varies. A server that remaps the whole pool on every resize pays
+ * for the full pool size each time, so its cost per resize climbs as the
+ * pool grows; one that leaks the old mappings gains a mapping per resize.
+ */
+TEST_F(ShmPoolResizeTest, repeated_growth_while_buffers_are_in_use)
+{
+    auto const iterations = wlcs::helpers::get_env_int("WLCS_POOL_RESIZE_ITERATIONS", 2000);
+
+    wlcs::Client client{the_server()};
+    auto surface = client.create_visible_surface(buffer_width, buffer_height);
+
+    wlcs::ShmPool pool{client, buffer_size};
+    auto buffer = std::make_unique<wlcs::ShmBuffer>(pool, 0, buffer_width, buffer_height);
+    show_buffer(client, surface, *buffer);
+
+    // The cost of showing a new buffer with no resize involved, for comparison
+    wlcs::LatencyRecorder without_resize;
+    for (int i = 0; i < 100; ++i)
+    {
+        auto next = std::make_unique<wlcs::ShmBuffer>(pool, 0, buffer_width, buffer_height);
+        without_resize.record(show_buffer(client, surface, *next));
+        buffer = std::move(next);
+    }
+
+    auto const baseline_mappings = wlcs::helpers::memory_mapping_count();
+    auto const baseline_memory = wlcs::helpers::resident_memory();
+
+    wlcs::LatencyRecorder early_resizes;
+    wlcs::LatencyRecorder late_resizes;
+    for (int i = 0; i < iterations; ++i)
+    {
+        auto const start = std::chrono::steady_clock::now();
+
+        // The previous buffer stays attached while the pool is resized under it
+        pool.resize(pool.size() + growth);
+
+        // The buffer's last pages are the ones the resize just added
+        auto next = std::make_unique<wlcs::ShmBuffer>(pool, pool.size() - buffer_size, buffer_width, buffer_height);
+        memset(static_cast<char*>(next->data()) + buffer_size - growth, 0xff, growth);
+        show_buffer(client, surface, *next);
+        buffer = std::move(next);
+
+        auto const elapsed = std::chrono::steady_clock::now() - start;
+        (i < iterations / 2 ? early_resizes : late_resizes).record(elapsed);
+    }
+
+    auto const mapping_growth = wlcs::helpers::memory_mapping_count() - baseline_mappings;
+    auto const memory_growth =
+        static_cast<double>(wlcs::helpers::resident_memory()) - static_cast<double>(baseline_memory);
+
+    without_resize.report("pool_resize_baseline_commit_to_frame");
+    early_resizes.report("pool_resize_early_resize_to_frame");
+    late_resizes.report("pool_resize_late_resize_to_frame");
+    wlcs::report_metric(
+        "pool_resize_cost_per_resize",
+        std::chrono::duration<double, std::micro>(late_resizes.mean() - without_resize.mean()).count(),
+        "us");
+    wlcs::report_metric("pool_resize_final_pool_size", pool.size() / 1024.0, "KiB");
+    // Includes our own pages of the pool, which is now its final size
+    wlcs::report_metric("pool_resize_resident_growth", memory_growth / 1024, "KiB");
+    wlcs::report_metric("pool_resize_mapping_growth", mapping_growth, "mappings");
+
+    EXPECT_THAT(mapping_growth, Le(mapping_slack)) << "Server kept stale mappings of a resized pool";
+}
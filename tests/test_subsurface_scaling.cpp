@@ -0,0 +1,181 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+using namespace testing;
+
+namespace
+{
+int const root_size{400};
+int const child_size{32};
+int const frame_count{100};
+
+enum class Shape
+{
+    deep,   ///< A chain: each subsurface is the parent of the next
+    wide    ///< Siblings: every subsurface is a child of the root
+};
+
+enum class Mode
+{
+    sync,
+    desync
+};
+
+struct TreeParams
+{
+    Shape shape;
+    Mode mode;
+    int size;
+};
+
+std::ostream& operator<<(std::ostream& out, TreeParams const& params)
+{
+    return out
+        << (params.shape == Shape::deep ? "deep" : "wide") << "_"
+        << (params.mode == Mode::sync ? "sync" : "desync") << "_"
+        << params.size;
+}
+}
+
+class SubsurfaceScalingTest :
+    public wlcs::InProcessServer,
+    public WithParamInterface<TreeParams>
+{
+};
+
+TEST_P(SubsurfaceScalingTest, parent_commit_cascade_cost)
+{
+    auto const params = GetParam();
+
+    wlcs::Client client{the_server()};
+    if (!client.subcompositor())
+    {
+        skip("Server does not support wl_subcompositor");
+        return;
+    }
+
+    auto root = client.create_visible_surface(root_size, root_size);
+    wlcs::ShmBuffer root_buffer{client, root_size, root_size};
+    wlcs::ShmBuffer child_buffer{client, child_size, child_size};
+
+    // Subsurfaces refer to their parents, so they mustn't move once created
+    std::vector<std::unique_ptr<wlcs::Subsurface>> children;
+    for (int i = 0; i < params.size; ++i)
+    {
+        wlcs::Surface& parent = (params.shape == Shape::deep && !children.empty()) ? *children.back() : root;
+        children.push_back(std::make_unique<wlcs::Subsurface>(client, parent));
+
+        auto& child = *children.back();
+        if (params.shape == Shape::deep)
+        {
+            wl_subsurface_set_position(child, 1, 1);
+        }
+        else
+        {
+            // Tile the root; once it's full, start again from the top left
+            int const per_row{root_size / child_size};
+            wl_subsurface_set_position(
+                child,
+                (i % per_row) * child_size,
+                (i / per_row % per_row) * child_size);
+        }
+
+        if (params.mode == Mode::sync)
+        {
+            wl_subsurface_set_sync(child);
+        }
+        else
+        {
+            wl_subsurface_set_desync(child);
+        }
+    }
+
+    auto const commit_tree =
+        [&]()
+        {
+            // Commit leaves first: a synchronised child's state is only applied by its parent's commit
+            for (auto child = children.rbegin(); child != children.rend(); ++child)
+            {
+                wl_surface_attach(**child, child_buffer, 0, 0);
+                wl_surface_damage(**child, 0, 0, child_size, child_size);
+                wl_surface_commit(**child);
+            }
+
+            wl_surface_attach(root, root_buffer, 0, 0);
+            wl_surface_damage(root, 0, 0, root_size, root_size);
+
+            bool frame_consumed{false};
+            root.add_frame_callback([&frame_consumed](auto) { frame_consumed = true; });
+
+            auto const start = std::chrono::steady_clock::now();
+            wl_surface_commit(root);
+            client.dispatch_until([&frame_consumed]() { return frame_consumed; });
+            return std::chrono::steady_clock::now() - start;
+        };
+
+    // Map the tree before measuring
+    commit_tree();
+
+    wlcs::LatencyRecorder commit_to_frame;
+    auto const start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frame_count; ++i)
+    {
+        commit_to_frame.record(commit_tree());
+    }
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+
+    std::ostringstream name;
+    name << "subsurface_" << params;
+    commit_to_frame.report(name.str() + "_root_commit_to_frame");
+    wlcs::report_metric(
+        name.str() + "_frame_rate",
+        frame_count / std::chrono::duration<double>(elapsed).count(),
+        "frames/s");
+}
+
+INSTANTIATE_TEST_CASE_P(
+    DeepTrees,
+    SubsurfaceScalingTest,
+    Values(
+        TreeParams{Shape::deep, Mode::sync, 10},
+        TreeParams{Shape::deep, Mode::sync, 50},
+        TreeParams{Shape::deep, Mode::sync, 100},
+        TreeParams{Shape::deep, Mode::desync, 10},
+        TreeParams{Shape::deep, Mode::desync, 50},
+        TreeParams{Shape::deep, Mode::desync, 100}));
+
+INSTANTIATE_TEST_CASE_P(
+    WideTrees,
+    SubsurfaceScalingTest,
+    Values(
+        TreeParams{Shape::wide, Mode::sync, 10},
+        TreeParams{Shape::wide, Mode::sync, 100},
+        TreeParams{Shape::wide, Mode::sync, 500},
+        TreeParams{Shape::wide, Mode::desync, 10},
+        TreeParams{Shape::wide, Mode::desync, 100},
+        TreeParams{Shape::wide, Mode::desync, 500}));
@@ -28,6 +28,12 @@
 #include "helpers.h"
 #include "in_process_server.h"
 
+#include <gmock/gmock.h>
+
+#include <chrono>
+
+using namespace testing;
+
 using ClientSurfaceEventsTest = wlcs::InProcessServer;
 
 //
@@ -286,76 +292,6 @@ using ClientSurfaceEventsTest = wlcs::InProcessServer;
 //	assert(surface_contains(client->surface, 50, 50));
 //	check_pointer(client, 50, 50);
 //}
-//
-//static int
-//output_contains_client(struct client *client)
-//{
-//	struct output *output = client->output;
-//	struct surface *surface = client->surface;
-//
-//	return !(output->x >= surface->x + surface->width
-//		|| output->x + output->width <= surface->x
-//		|| output->y >= surface->y + surface->height
-//		|| output->y + output->height <= surface->y);
-//}
-//
-//static void
-//check_client_move(struct client *client, int x, int y)
-//{
-//	move_client(client, x, y);
-//
-//	if (output_contains_client(client)) {
-//		assert(client->surface->output == client->output);
-//	} else {
-//		assert(client->surface->output == NULL);
-//	}
-//}
-//
-//TEST(test_surface_output)
-//{
-//	struct client *client;
-//	int x, y;
-//
-//	client = create_client_and_test_surface(100, 100, 100, 100);
-//	assert(client);
-//
-//	assert(output_contains_client(client));
-//
-//	/* not visible */
-//	x = 0;
-//	y = -client->surface->height;
-//	check_client_move(client, x, y);
-//
-//	/* visible */
-//	check_client_move(client, x, ++y);
-//
-//	/* not visible */
-//	x = -client->surface->width;
-//	y = 0;
-//	check_client_move(client, x, y);
-//
-//	/* visible */
-//	check_client_move(client, ++x, y);
-//
-//	/* not visible */
-//	x = client->output->width;
-//	y = 0;
-//	check_client_move(client, x, y);
-//
-//	/* visible */
-//	check_client_move(client, --x, y);
-//	assert(output_contains_client(client));
-//
-//	/* not visible */
-//	x = 0;
-//	y = client->output->height;
-//	check_client_move(client, x, y);
-//	assert(!output_contains_client(client));
-//
-//	/* visible */
-//	check_client_move(client, x, --y);
-//	assert(output_contains_client(client));
-//}
 
 TEST_F(ClientSurfaceEventsTest, buffer_release)
 {
@@ -449,3 +385,108 @@ TEST_F(ClientSurfaceEventsTest, buffer_release)
     EXPECT_TRUE(buffer_released[1]);
     EXPECT_TRUE(buffer_released[2]);
 }
+
+namespace
+{
+bool output_contains(wlcs::OutputState const& output, int x, int y, int width, int height)
+{
+    return !(output.x >= x + width
+        || output.x + output.width <= x
+        || output.y >= y + height
+        || output.y + output.height <= y);
+}
+
+/*
+ * Enter and leave events are typically sent when the compositor next
+ * composites, so give the server a little time to catch up.
+ */
+bool wait_for_outputs(
+    wlcs::Client& client,
+    wlcs::Surface const& surface,
+    std::function<bool(std::set<uint32_t> const&)> const& expected)
+{
+    auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds{1};
+    while (!expected(surface.current_outputs()))
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        client.roundtrip();
+    }
+    return true;
+}
+}
+
+TEST_F(ClientSurfaceEventsTest, surface_output)
+{
+    int const width{100};
+    int const height{100};
+
+    wlcs::Client client{the_server()};
+
+    auto surface = client.create_visible_surface(width, height);
+    wlcs::ShmBuffer buffer{client, width, height};
+    wl_surface_attach(surface, buffer, 0, 0);
+    wl_surface_damage(surface, 0, 0, width, height);
+    wl_surface_commit(surface);
+
+    ASSERT_THAT(client.outputs(), Not(IsEmpty()));
+    auto const output = client.outputs().front();
+
+    auto const check_surface_move =
+        [&](int x, int y)
+        {
+            the_server().move_surface_to(surface, x, y);
+
+            bool const visible = output_contains(output, x, y, width, height);
+            EXPECT_TRUE(wait_for_outputs(
+                client,
+                surface,
+                [&output, visible](auto const& outputs) { return outputs.count(output.name) == (visible ? 1u : 0u); }))
+                << "Surface at (" << x << ", " << y << ") should " << (visible ? "" : "not ")
+                << "be on output " << output.name;
+        };
+
+    try
+    {
+        check_surface_move(output.x, output.y);
+    }
+    catch (wlcs::ShimNotImplemented const&)
+    {
+        skip("Shim does not implement wlcs_server_position_window_absolute");
+        return;
+    }
+
+    /* not visible */
+    int x = output.x;
+    int y = output.y - height;
+    check_surface_move(x, y);
+
+    /* visible */
+    check_surface_move(x, ++y);
+
+    /* not visible */
+    x = output.x - width;
+    y = output.y;
+    check_surface_move(x, y);
+
+    /* visible */
+    check_surface_move(++x, y);
+
+    /* not visible */
+    x = output.x + output.width;
+    y = output.y;
+    check_surface_move(x, y);
+
+    /* visible */
+    check_surface_move(--x, y);
+
+    /* not visible */
+    x = output.x;
+    y = output.y + output.height;
+    check_surface_move(x, y);
+
+    /* visible */
+    check_surface_move(x, --y);
+}
@@ -0,0 +1,308 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+using namespace testing;
+
+namespace
+{
+int const surface_count{5};
+int const surface_size{100};
+int const points_per_surface{2};
+int const touch_points{surface_count * points_per_surface};
+int const frame_count{1000};
+int const burst_frame_count{1000};
+// Offset of every contact in the last frame of a burst, which no earlier frame uses
+int const burst_final_offset{7};
+
+int surface_left(int surface_index)
+{
+    return 20 + surface_index * (surface_size + 20);
+}
+
+int const surface_top{20};
+
+// Each surface has two contacts, at a quarter and three-quarters of its width
+int point_local_x(int slot)
+{
+    return (slot % points_per_surface) * surface_size / 2 + surface_size / 4;
+}
+
+struct TimedTouchEvent
+{
+    wlcs::TouchEvent event;
+    std::chrono::steady_clock::time_point received;
+};
+
+using TouchFrame = std::vector<TimedTouchEvent>;
+}
+
+using TouchStressTest = wlcs::InProcessServer;
+
+TEST_F(TouchStressTest, ten_point_touch_streams_are_grouped_per_frame)
+{
+    wlcs::Client client{the_server()};
+
+    std::vector<wlcs::Surface> surfaces;
+    std::vector<wlcs::ShmBuffer> buffers;
+    for (int i = 0; i < surface_count; ++i)
+    {
+        surfaces.push_back(client.create_visible_surface(surface_size, surface_size));
+        buffers.emplace_back(client, surface_size, surface_size);
+
+        auto& surface = surfaces.back();
+        wl_surface_attach(surface, buffers.back(), 0, 0);
+        wl_surface_damage(surface, 0, 0, surface_size, surface_size);
+        wl_surface_commit(surface);
+
+        try
+        {
+            the_server().move_surface_to(surface, surface_left(i), surface_top);
+        }
+        catch (wlcs::ShimNotImplemented const&)
+        {
+            skip("Shim does not implement wlcs_server_position_window_absolute");
+            return;
+        }
+    }
+
+    bool frame_consumed{false};
+    surfaces.back().add_frame_callback([&frame_consumed](auto) { frame_consumed = true; });
+    wl_surface_commit(surfaces.back());
+    client.dispatch_until([&frame_consumed]() { return frame_consumed; });
+
+    std::vector<TouchFrame> frames;
+    TouchFrame pending;
+    client.add_touch_listener(
+        [&frames, &pending](wlcs::TouchEvent const& event)
+        {
+            auto const now = std::chrono::steady_clock::now();
+            if (event.type == wlcs::TouchEvent::Type::frame)
+            {
+                frames.push_back(std::move(pending));
+                pending.clear();
+            }
+            else
+            {
+                pending.push_back(TimedTouchEvent{event, now});
+            }
+        });
+
+    std::unique_ptr<wlcs::Touch> touch_device;
+    try
+    {
+        touch_device = std::make_unique<wlcs::Touch>(the_server().create_touch());
+    }
+    catch (wlcs::ShimNotImplemented const&)
+    {
+        skip("Shim does not implement the touch hooks");
+        return;
+    }
+    auto& touch = *touch_device;
+
+    auto const inject_and_wait =
+        [&](std::function<void(int slot)> const& change, wlcs::LatencyRecorder& latency)
+        {
+            auto const expected_frames = frames.size() + 1;
+
+            auto const injected = std::chrono::steady_clock::now();
+            for (int slot = 0; slot < touch_points; ++slot)
+            {
+                change(slot);
+            }
+            touch.frame();
+
+            client.dispatch_until([&]() { return frames.size() >= expected_frames; });
+
+            for (auto const& event : frames.back())
+            {
+                latency.record(event.received - injected);
+            }
+        };
+
+    wlcs::LatencyRecorder down_latency;
+    inject_and_wait(
+        [&touch](int slot)
+        {
+            touch.down_at(
+                slot,
+                surface_left(slot / points_per_surface) + point_local_x(slot),
+                surface_top + surface_size / 2);
+        },
+        down_latency);
+
+    // Every contact should land on the surface under it, in a single frame
+    std::map<int32_t, int> slot_for_id;
+    ASSERT_THAT(frames.back(), SizeIs(touch_points));
+    for (auto const& timed : frames.back())
+    {
+        auto const& event = timed.event;
+        ASSERT_THAT(event.type, Eq(wlcs::TouchEvent::Type::down));
+
+        auto const surface = std::find_if(
+            surfaces.begin(),
+            surfaces.end(),
+            [&event](auto const& candidate) { return static_cast<wl_surface*>(candidate) == event.surface; });
+        ASSERT_THAT(surface, Ne(surfaces.end()));
+
+        auto const surface_index = static_cast<int>(surface - surfaces.begin());
+        auto const slot = surface_index * points_per_surface +
+            (wl_fixed_to_int(event.x) < surface_size / 2 ? 0 : 1);
+        EXPECT_THAT(wl_fixed_to_int(event.x), Eq(point_local_x(slot)));
+
+        EXPECT_TRUE(slot_for_id.insert(std::make_pair(event.id, slot)).second)
+            << "Touch id " << event.id << " assigned to multiple contacts";
+    }
+    ASSERT_THAT(slot_for_id, SizeIs(touch_points));
+
+    wlcs::LatencyRecorder motion_latency;
+    int misgrouped_frames{0};
+    auto const start = std::chrono::steady_clock::now();
+    for (int i = 1; i <= frame_count; ++i)
+    {
+        // Wiggle every contact within its surface
+        auto const offset = (i % 2) ? 5 : -5;
+        inject_and_wait(
+            [&touch, offset](int slot)
+            {
+                touch.move_to(
+                    slot,
+                    surface_left(slot / points_per_surface) + point_local_x(slot) + offset,
+                    surface_top + surface_size / 2 + offset);
+            },
+            motion_latency);
+
+        std::set<int32_t> ids_in_frame;
+        for (auto const& timed : frames.back())
+        {
+            if (timed.event.type == wlcs::TouchEvent::Type::motion &&
+                slot_for_id.count(timed.event.id))
+            {
+                ids_in_frame.insert(timed.event.id);
+            }
+        }
+        if (frames.back().size() != static_cast<size_t>(touch_points) ||
+            ids_in_frame.size() != static_cast<size_t>(touch_points))
+        {
+            ++misgrouped_frames;
+        }
+    }
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+
+    /*
+     * Now inject as a touchscreen would, without waiting for each frame to
+     * arrive. The server may coalesce frames it can't keep up with, but each
+     * group it sends must still hold one motion for every contact.
+     */
+    auto const frames_before_burst = frames.size();
+    auto const burst_start = std::chrono::steady_clock::now();
+    for (int i = 1; i <= burst_frame_count; ++i)
+    {
+        auto const offset = i == burst_frame_count ? burst_final_offset : ((i % 2) ? 5 : -5);
+        for (int slot = 0; slot < touch_points; ++slot)
+        {
+            touch.move_to(
+                slot,
+                surface_left(slot / points_per_surface) + point_local_x(slot) + offset,
+                surface_top + surface_size / 2 + offset);
+        }
+        touch.frame();
+    }
+    auto const burst_injected = std::chrono::steady_clock::now();
+
+    auto const burst_complete = [&]()
+        {
+            if (frames.size() == frames_before_burst)
+            {
+                return false;
+            }
+            auto const& last = frames.back();
+            return last.size() == static_cast<size_t>(touch_points) &&
+                std::all_of(
+                    last.begin(),
+                    last.end(),
+                    [](auto const& timed)
+                    {
+                        return timed.event.type == wlcs::TouchEvent::Type::motion &&
+                            wl_fixed_to_int(timed.event.y) == surface_size / 2 + burst_final_offset;
+                    });
+        };
+    ASSERT_TRUE(client.dispatch_until(burst_complete, std::chrono::seconds{10}))
+        << "Last frame of the burst never arrived";
+    auto const burst_delivered = std::chrono::steady_clock::now();
+
+    int misgrouped_burst_frames{0};
+    for (auto frame = frames.begin() + frames_before_burst; frame != frames.end(); ++frame)
+    {
+        std::set<int32_t> ids_in_frame;
+        for (auto const& timed : *frame)
+        {
+            if (timed.event.type == wlcs::TouchEvent::Type::motion &&
+                slot_for_id.count(timed.event.id))
+            {
+                ids_in_frame.insert(timed.event.id);
+            }
+        }
+        if (frame->size() != static_cast<size_t>(touch_points) ||
+            ids_in_frame.size() != static_cast<size_t>(touch_points))
+        {
+            ++misgrouped_burst_frames;
+        }
+    }
+    auto const burst_frames_delivered = static_cast<int>(frames.size() - frames_before_burst);
+
+    wlcs::LatencyRecorder up_latency;
+    inject_and_wait([&touch](int slot) { touch.up(slot); }, up_latency);
+    EXPECT_THAT(frames.back(), SizeIs(touch_points));
+
+    down_latency.report("touch_down_latency");
+    motion_latency.report("touch_motion_latency");
+    up_latency.report("touch_up_latency");
+    // Each of these frames waited for the previous one to arrive
+    wlcs::report_metric(
+        "touch_lockstep_frame_rate",
+        frame_count / std::chrono::duration<double>(elapsed).count(),
+        "frames/s");
+    wlcs::report_metric(
+        "touch_burst_injection_rate",
+        burst_frame_count / std::chrono::duration<double>(burst_injected - burst_start).count(),
+        "frames/s");
+    wlcs::report_metric(
+        "touch_burst_delivery_time",
+        std::chrono::duration<double, std::milli>(burst_delivered - burst_start).count(),
+        "ms");
+    wlcs::report_metric("touch_burst_frames_delivered", burst_frames_delivered, "frames");
+    wlcs::report_metric("touch_burst_frames_coalesced", burst_frame_count - burst_frames_delivered, "frames");
+
+    EXPECT_THAT(misgrouped_frames, Eq(0))
+        << "Each injected frame should arrive as one wl_touch.frame group containing every contact";
+    EXPECT_THAT(misgrouped_burst_frames, Eq(0))
+        << "Each wl_touch.frame group in a burst should contain one motion for every contact";
+    EXPECT_THAT(pending, IsEmpty()) << "Touch events delivered without a terminating wl_touch.frame";
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "helpers.h"
+#include "in_process_server.h"
+#include "metrics.h"
+#include "viewporter-client-protocol.h"
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace testing;
+
+namespace
+{
+int const video_width{1920};
+int const video_height{1080};
+int const frame_count{240};
+// Frames cycle through these, as through a decoder's output pool. Each frame
+// waits for its frame callback, not for wl_buffer.release, before the next.
+int const buffer_count{3};
+
+struct Viewport
+{
+    char const* name;
+    /// Source rectangle, in buffer coordinates; a zero width means the whole buffer
+    int src_x, src_y, src_width, src_height;
+    int dst_width, dst_height;
+};
+
+std::ostream& operator<<(std::ostream& out, Viewport const& viewport)
+{
+    return out << viewport.name;
+}
+}
+
+class ViewporterScalingTest :
+    public wlcs::InProcessServer,
+    public WithParamInterface<Viewport>
+{
+};
+
+/*
+ * Stream video-sized frames, as a media player would, letting the server
+ * scale (and crop) them to the window rather than scaling them on the CPU.
+ * Each frame is a different buffer, fully damaged.
+ */
+TEST_P(ViewporterScalingTest, video_stream_throughput)
+{
+    auto const& params = GetParam();
+
+    wlcs::Client client{the_server()};
+    if (!client.viewporter())
+    {
+        skip("Server does not support wp_viewporter");
+        return;
+    }
+
+    auto surface = client.create_visible_surface(params.dst_width, params.dst_height);
+    auto const viewport = wp_viewporter_get_viewport(client.viewporter(), surface);
+    surface.run_on_destruction([viewport]() { wp_viewport_destroy(viewport); });
+    if (params.src_width > 0)
+    {
+        wp_viewport_set_source(
+            viewport,
+            wl_fixed_from_int(params.src_x),
+            wl_fixed_from_int(params.src_y),
+            wl_fixed_from_int(params.src_width),
+            wl_fixed_from_int(params.src_height));
+    }
+    wp_viewport_set_destination(viewport, params.dst_width, params.dst_height);
+
+    std::vector<wlcs::ShmBuffer> buffers;
+    for (int i = 0; i < buffer_count; ++i)
+    {
+        buffers.emplace_back(client, video_width, video_height);
+        memset(buffers.back().data(), 0x40 * (i + 1), static_cast<size_t>(buffers.back().stride()) * video_height);
+    }
+
+    wlcs::LatencyRecorder commit_to_frame;
+    auto const start = std::chrono::steady_clock::now();
+    auto const cpu_start = wlcs::helpers::process_cpu_time();
+    for (int i = 0; i < frame_count; ++i)
+    {
+        wl_surface_attach(surface, buffers[i % buffer_count], 0, 0);
+        wl_surface_damage(surface, 0, 0, params.dst_width, params.dst_height);
+
+        bool frame_consumed{false};
+        surface.add_frame_callback([&frame_consumed](auto) { frame_consumed = true; });
+
+        auto const committed = std::chrono::steady_clock::now();
+        wl_surface_commit(surface);
+        client.dispatch_until([&frame_consumed]() { return frame_consumed; });
+        commit_to_frame.record(std::chrono::steady_clock::now() - committed);
+    }
+    auto const cpu_time = wlcs::helpers::process_cpu_time() - cpu_start;
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+
+    auto const name = std::string{"viewporter_"} + params.name;
+    commit_to_frame.report(name + "_commit_to_frame");
+    wlcs::report_metric(
+        name + "_throughput",
+        frame_count / std::chrono::duration<double>(elapsed).count(),
+        "frames/s");
+    wlcs::report_metric(
+        name + "_cpu_time_per_frame",
+        std::chrono::duration<double, std::micro>(cpu_time).count() / frame_count,
+        "us");
+}
+
+INSTANTIATE_TEST_CASE_P(
+    VideoViewports,
+    ViewporterScalingTest,
+    Values(
+        Viewport{"unscaled", 0, 0, 0, 0, 1920, 1080},
+        Viewport{"downscale_720p", 0, 0, 0, 0, 1280, 720},
+        Viewport{"downscale_thumbnail", 0, 0, 0, 0, 320, 180},
+        Viewport{"upscale_2160p", 0, 0, 0, 0, 3840, 2160},
+        Viewport{"letterbox_stretch", 0, 0, 0, 0, 1920, 800},
+        Viewport{"crop_centre", 480, 270, 960, 540, 1920, 1080},
+        Viewport{"crop_and_downscale", 240, 0, 1440, 1080, 960, 720}));
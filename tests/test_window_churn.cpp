@@ -0,0 +1,130 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "helpers.h"
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+using namespace testing;
+
+namespace
+{
+int const frames_per_window{3};
+int const samples{10};
+
+// Per-client resources the compositor may legitimately cache, such as pooled fds
+int const resource_slack{8};
+
+void open_window_and_close(wlcs::Server& server)
+{
+    wlcs::Client client{server};
+
+    auto surface = client.create_visible_surface(100, 100);
+    wlcs::ShmBuffer buffer{client, 100, 100};
+
+    for (int frame = 0; frame < frames_per_window; ++frame)
+    {
+        wl_surface_attach(surface, buffer, 0, 0);
+        wl_surface_damage(surface, 0, 0, 100, 100);
+
+        bool frame_consumed{false};
+        surface.add_frame_callback([&frame_consumed](auto) { frame_consumed = true; });
+        wl_surface_commit(surface);
+        client.dispatch_until([&frame_consumed]() { return frame_consumed; });
+    }
+}
+
+/*
+ * The server cleans up after a client disconnects asynchronously, so give
+ * it a chance to release its resources before concluding anything leaked.
+ */
+void wait_for_resources_to_settle(int fd_limit, int mapping_limit)
+{
+    auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+    while (std::chrono::steady_clock::now() < deadline &&
+           (wlcs::helpers::open_file_count() > fd_limit ||
+            wlcs::helpers::memory_mapping_count() > mapping_limit))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+}
+}
+
+using WindowChurnTest = wlcs::InProcessServer;
+
+TEST_F(WindowChurnTest, repeated_open_and_close_does_not_leak)
+{
+    auto const iterations = wlcs::helpers::get_env_int("WLCS_CHURN_ITERATIONS", 2000);
+    auto const iterations_per_sample = std::max(iterations / samples, 1);
+
+    // Let the compositor do any lazy initialisation before we take a baseline
+    open_window_and_close(the_server());
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+
+    auto const baseline_fds = wlcs::helpers::open_file_count();
+    auto const baseline_mappings = wlcs::helpers::memory_mapping_count();
+    auto const baseline_memory = wlcs::helpers::resident_memory();
+
+    auto const start = std::chrono::steady_clock::now();
+    auto sample_start = start;
+    for (int i = 1; i <= iterations; ++i)
+    {
+        open_window_and_close(the_server());
+
+        if (i % iterations_per_sample == 0)
+        {
+            auto const now = std::chrono::steady_clock::now();
+            std::cout
+                << i << " windows: "
+                << iterations_per_sample / std::chrono::duration<double>(now - sample_start).count()
+                << " windows/s, "
+                << (static_cast<double>(wlcs::helpers::resident_memory()) - baseline_memory) / 1024
+                << " KiB resident growth, "
+                << wlcs::helpers::open_file_count() - baseline_fds << " fd growth, "
+                << wlcs::helpers::memory_mapping_count() - baseline_mappings << " mapping growth"
+                << std::endl;
+            sample_start = now;
+        }
+    }
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+
+    wait_for_resources_to_settle(baseline_fds + resource_slack, baseline_mappings + resource_slack);
+
+    auto const fd_growth = wlcs::helpers::open_file_count() - baseline_fds;
+    auto const mapping_growth = wlcs::helpers::memory_mapping_count() - baseline_mappings;
+    auto const memory_growth =
+        static_cast<double>(wlcs::helpers::resident_memory()) - static_cast<double>(baseline_memory);
+
+    wlcs::report_metric(
+        "churn_windows_per_second",
+        iterations / std::chrono::duration<double>(elapsed).count(),
+        "windows/s");
+    wlcs::report_metric("churn_resident_growth_per_1000_windows", memory_growth / iterations * 1000 / 1024, "KiB");
+    wlcs::report_metric("churn_fd_growth", fd_growth, "fds");
+    wlcs::report_metric("churn_mapping_growth", mapping_growth, "mappings");
+
+    EXPECT_THAT(fd_growth, Le(resource_slack)) << "File descriptors leaked over " << iterations << " windows";
+    EXPECT_THAT(mapping_growth, Le(resource_slack)) << "Memory mappings leaked over " << iterations << " windows";
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright © 2017 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Christopher James Halse Rogers <christopher.halse.rogers@canonical.com>
+ */
+
+#include "in_process_server.h"
+#include "metrics.h"
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+
+using namespace testing;
+
+namespace
+{
+int const window_count{100};
+int const default_width{200};
+int const default_height{200};
+}
+
+using XdgToplevelStartupTest = wlcs::InProcessServer;
+
+/*
+ * Mapping an xdg_toplevel costs the client an initial commit, a wait for
+ * the first configure, then an ack and a commit of the first buffer before
+ * the window is on screen. Measure each stage, as an application sees it.
+ */
+TEST_F(XdgToplevelStartupTest, configure_ack_commit_round_trip)
+{
+    wlcs::Client client{the_server()};
+    if (!client.xdg_shell())
+    {
+        skip("Server does not support xdg_wm_base");
+        return;
+    }
+
+    wlcs::LatencyRecorder first_configure;
+    wlcs::LatencyRecorder ack_to_frame;
+    wlcs::LatencyRecorder time_to_mapped;
+
+    for (int i = 0; i < window_count; ++i)
+    {
+        auto const start = std::chrono::steady_clock::now();
+
+        wlcs::Surface surface{client};
+        wlcs::XdgToplevel toplevel{surface};
+
+        bool configured{false};
+        int32_t width{0}, height{0};
+        uint32_t serial{0};
+        toplevel.add_configure_listener(
+            [&](int32_t configured_width, int32_t configured_height, uint32_t configured_serial)
+            {
+                configured = true;
+                width = configured_width;
+                height = configured_height;
+                serial = configured_serial;
+            });
+
+        wl_surface_commit(surface);
+        client.dispatch_until([&configured]() { return configured; });
+        auto const configure_received = std::chrono::steady_clock::now();
+
+        // A zero size means the client gets to choose
+        auto const buffer_width = width > 0 ? width : default_width;
+        auto const buffer_height = height > 0 ? height : default_height;
+        wlcs::ShmBuffer buffer{client, buffer_width, buffer_height};
+
+        // Allocating the buffer is the client's cost, not the server's
+        auto const acked = std::chrono::steady_clock::now();
+        toplevel.ack_configure(serial);
+        wl_surface_attach(surface, buffer, 0, 0);
+        wl_surface_damage(surface, 0, 0, buffer_width, buffer_height);
+
+        bool frame_consumed{false};
+        surface.add_frame_callback([&frame_consumed](auto) { frame_consumed = true; });
+        wl_surface_commit(surface);
+        client.dispatch_until([&frame_consumed]() { return frame_consumed; });
+        auto const mapped = std::chrono::steady_clock::now();
+
+        first_configure.record(configure_received - start);
+        ack_to_frame.record(mapped - acked);
+        time_to_mapped.record(mapped - start);
+    }
+
+    first_configure.report("xdg_time_to_first_configure");
+    ack_to_frame.report("xdg_ack_commit_to_frame");
+    time_to_mapped.report("xdg_time_to_mapped");
+}